@@ -0,0 +1,73 @@
+#!/bin/sh
+# make bench-compile: times cc on the programs from bench/gen.c.
+#
+#   bench/compile.sh [save]
+#
+# The time is what --stats reports for lexing, parsing, code generation
+# and output, without starting the process. With save, the results become
+# the baseline that later runs are compared with.
+
+CC=${CC:-./cc}
+FLAGS=${FLAGS:--mabi=sysv -c}
+DIR=bench-compile.d
+BASELINE=bench-compile.baseline
+
+# Big enough that anything quadratic in the number of symbols, strings or
+# locals stands out from the linear part
+SIZES="fns:20000 globals:20000 expr:2000 strings:20000 idents:10000"
+
+mkdir -p $DIR
+: > $DIR/results
+
+for spec in $SIZES; do
+    kind=${spec%:*}
+    n=${spec#*:}
+
+    $CC --run bench/gen.c $kind $n > $DIR/$kind.c || exit 1
+    lines=$(wc -l < $DIR/$kind.c)
+
+    $CC $FLAGS --stats=json -o $DIR/$kind.o $DIR/$kind.c > $DIR/$kind.json || exit 1
+
+    awk -v kind=$kind -v lines=$lines '{
+        for (i = 1; i <= NF; i++) {
+            key = $i
+            gsub(/[":{]/, "", key)
+            value = $(i+1)
+            gsub(/[",}]/, "", value)
+            field[key] = value
+        }
+
+        us = field["lex_us"] + field["parse_us"] + field["emit_us"] + field["output_us"]
+
+        if (us < 1)
+            us = 1
+
+        printf "%s %d %d %d %d\n", kind, lines, field["tokens"], us, field["peak_kb"]
+    }' $DIR/$kind.json >> $DIR/results
+done
+
+if [ "$1" = save ]; then
+    cp $DIR/results $BASELINE
+    echo "saved $BASELINE"
+fi
+
+# Rates against the baseline, if there is one
+awk -v baseline=$BASELINE '
+    BEGIN {
+        while ((getline line < baseline) > 0) {
+            split(line, f, " ")
+            base[f[1]] = f[3] / f[4]
+            base_kb[f[1]] = f[5]
+        }
+
+        printf "%-8s %8s %8s %10s %12s %12s %9s %14s\n", "program", "lines", "tokens", "us", "lines/s", "tokens/s", "peak KB", "vs baseline"
+    }
+    {
+        rate = $3 / $4
+        change = "-"
+
+        if ($1 in base)
+            change = sprintf("%.2fx %+d KB", rate / base[$1], $5 - base_kb[$1])
+
+        printf "%-8s %8d %8d %10d %12d %12d %9d %14s\n", $1, $2, $3, $4, $2 * 1000000 / $4, rate * 1000000, $5, change
+    }' $DIR/results
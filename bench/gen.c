@@ -0,0 +1,114 @@
+//Synthetic programs for make bench-compile, written in the subset mini-c
+//compiles so that it runs with cc --run:
+//
+//    gen fns N       N functions, each calling the one before
+//    globals N       N globals, added up by main
+//    expr N          an expression nested N deep
+//    strings N       N different string literals of about 200 characters
+//    idents N        a chain of N locals with 100 character names
+
+char* long_text;
+char* long_name;
+
+void fns (int n) {
+    int i = 1;
+
+    printf("int f0 (int x) {\n    return x;\n}\n\n");
+
+    while (i < n) {
+        printf("int f%d (int x) {\n    return f%d(x) + 1;\n}\n\n", i, i-1);
+        i++;
+    }
+
+    printf("int main () {\n    return f%d(0) & 255;\n}\n", n-1);
+}
+
+void globals (int n) {
+    int i = 0;
+
+    while (i < n) {
+        printf("int g%d = %d;\n", i, i & 255);
+        i++;
+    }
+
+    printf("\nint main () {\n    int s = 0;\n");
+
+    for (i = 0; i < n; i++)
+        printf("    s = s + g%d;\n", i);
+
+    printf("    return s & 255;\n}\n");
+}
+
+void expr (int n) {
+    int i = 0;
+
+    printf("int main () {\n    int a = 1;\n    return ");
+
+    for (i = 0; i < n; i++)
+        printf("(a + ");
+
+    printf("a");
+
+    for (i = 0; i < n; i++)
+        printf(")");
+
+    printf(" & 255;\n}\n");
+}
+
+void strings (int n) {
+    int i = 0;
+
+    printf("int main () {\n");
+
+    for (i = 0; i < n; i++)
+        printf("    puts(\"%s %d\");\n", long_text, i);
+
+    printf("    return 0;\n}\n");
+}
+
+void idents (int n) {
+    int i = 1;
+
+    printf("int main () {\n    int %s0 = 1;\n", long_name);
+
+    while (i < n) {
+        printf("    int %s%d = %s%d + 1;\n", long_name, i, long_name, i-1);
+        i++;
+    }
+
+    printf("    return %s%d & 255;\n}\n", long_name, n-1);
+}
+
+int main (int argc, char** argv) {
+    int n = 0;
+
+    long_text = "The quick brown fox jumps over the lazy dog, then the dog gets up and "
+                "chases the fox all the way back across the field, past the barn and the "
+                "well, until both of them lie down in the grass";
+    long_name = "a_rather_long_local_variable_name_that_goes_on_and_on_for_quite_a_while_"
+                "before_it_gets_a_number_";
+
+    if (argc < 3) {
+        puts("usage: gen fns|globals|expr|strings|idents N");
+        return 1;
+    }
+
+    n = atoi(argv[2]);
+
+    if (strcmp(argv[1], "fns") == 0)
+        fns(n);
+    else if (strcmp(argv[1], "globals") == 0)
+        globals(n);
+    else if (strcmp(argv[1], "expr") == 0)
+        expr(n);
+    else if (strcmp(argv[1], "strings") == 0)
+        strings(n);
+    else if (strcmp(argv[1], "idents") == 0)
+        idents(n);
+    else {
+        puts("gen: unknown kind");
+        return 1;
+    }
+
+    return 0;
+}
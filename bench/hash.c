@@ -0,0 +1,41 @@
+//make bench-run: a string hash over a megabyte of text, byte by byte.
+//The hash is kept to 24 bits so that gcc's 4 byte int agrees.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int hash (char* s, int length) {
+    int h = 0;
+    int i = 0;
+
+    for (i = 0; i < length; i++)
+        h = ((h * 31) + (s[i] & 255)) & 16777215;
+
+    return h;
+}
+
+int main () {
+    int length = 1048576;
+    char* text = calloc(length + 1, 1);
+    char* words = "lorem ipsum dolor sit amet consectetur adipiscing elit ";
+    int n = strlen(words);
+    int i = 0;
+    int j = 0;
+    int h = 0;
+
+    for (i = 0; i < length; i++) {
+        text[i] = words[j];
+        j++;
+
+        if (j == n)
+            j = 0;
+    }
+
+    for (i = 0; i < 20; i++)
+        h = (h + hash(text, length - i)) & 16777215;
+
+    free(text);
+    printf("%d\n", h);
+    return 0;
+}
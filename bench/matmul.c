@@ -0,0 +1,54 @@
+//make bench-run: naive matrix multiply on malloced arrays, row after row.
+//The values stay small enough for gcc's 4 byte int.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int n;
+
+int* matrix (int seed) {
+    int* m = calloc(n * n, 8);
+    int i = 0;
+
+    for (i = 0; i < n * n; i++)
+        m[i] = (i + seed) & 7;
+
+    return m;
+}
+
+int main () {
+    int* a = 0;
+    int* b = 0;
+    int* c = 0;
+    int i = 0;
+    int j = 0;
+    int k = 0;
+    int sum = 0;
+
+    n = 300;
+    a = matrix(1);
+    b = matrix(2);
+    c = matrix(0);
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < n; j++) {
+            sum = 0;
+
+            for (k = 0; k < n; k++)
+                sum = sum + (a[(i * n) + k] * b[(k * n) + j]);
+
+            c[(i * n) + j] = sum;
+        }
+    }
+
+    sum = 0;
+
+    for (i = 0; i < n * n; i++)
+        sum = (sum + c[i]) & 16777215;
+
+    free(a);
+    free(b);
+    free(c);
+    printf("%d\n", sum);
+    return 0;
+}
@@ -0,0 +1,78 @@
+#!/bin/sh
+# make bench-run: how fast the code mini-c generates runs, against the
+# same programs built with gcc -O0.
+#
+# Each kernel in bench/ is built both ways and run natively, and both
+# must print the same. The last one is cc.c itself, compiling a program
+# from bench/gen.c. The sizes are those of .text in the objects.
+
+CC=${CC:-./cc}
+FLAGS=${FLAGS:--mabi=sysv}
+GCC="gcc -O0 -w"
+DIR=bench-run.d
+
+now () {
+    date +%s%N
+}
+
+text_size () {
+    size -A "$1" | awk '$1 == ".text" { print $2 }'
+}
+
+# name, then the command: prints the milliseconds and keeps the output
+timed () {
+    name=$1
+    shift
+    start=$(now)
+    "$@" > $DIR/$name.txt || echo "$name: exit status $?" >> $DIR/$name.txt
+    end=$(now)
+    echo $(( (end - start) / 1000000 ))
+}
+
+report () {
+    awk -v name=$1 -v mt=$2 -v gt=$3 -v ms=$4 -v gs=$5 -v same=$6 'BEGIN {
+        if (gt < 1) gt = 1
+        if (gs < 1) gs = 1
+        printf "%-8s %10d %10d %7.2fx %10d %10d %7.2fx  %s\n", name, mt, gt, mt / gt, ms, gs, ms / gs, same
+    }'
+}
+
+compare () {
+    if cmp -s $DIR/$1.mini.txt $DIR/$1.gcc.txt; then
+        echo ok
+    else
+        echo "OUTPUT DIFFERS"
+    fi
+}
+
+mkdir -p $DIR
+
+printf "%-8s %10s %10s %8s %10s %10s %8s\n" kernel "mini-c ms" "gcc ms" ratio "mini-c B" "gcc B" ratio
+
+for kernel in fib sieve matmul hash; do
+    $CC $FLAGS -c -o $DIR/$kernel.mini.o bench/$kernel.c > /dev/null || exit 1
+    gcc -no-pie $DIR/$kernel.mini.o -o $DIR/$kernel.mini || exit 1
+    $GCC -c bench/$kernel.c -o $DIR/$kernel.gcc.o || exit 1
+    gcc $DIR/$kernel.gcc.o -o $DIR/$kernel.gcc || exit 1
+
+    mt=$(timed $kernel.mini $DIR/$kernel.mini)
+    gt=$(timed $kernel.gcc $DIR/$kernel.gcc)
+    report $kernel $mt $gt $(text_size $DIR/$kernel.mini.o) $(text_size $DIR/$kernel.gcc.o) "$(compare $kernel)"
+done
+
+# The compiler on a big input. Both builds must write the same object.
+$CC --run bench/gen.c fns 20000 > $DIR/input.c || exit 1
+$CC $FLAGS -c -o $DIR/cc.mini.o cc.c > /dev/null || exit 1
+gcc -no-pie $DIR/cc.mini.o -o $DIR/cc.mini || exit 1
+$GCC -c cc.c -o $DIR/cc.gcc.o || exit 1
+gcc $DIR/cc.gcc.o -o $DIR/cc.gcc || exit 1
+
+mt=$(timed cc.mini $DIR/cc.mini -mabi=sysv -c -o $DIR/input.mini.o $DIR/input.c)
+gt=$(timed cc.gcc $DIR/cc.gcc -mabi=sysv -c -o $DIR/input.gcc.o $DIR/input.c)
+sed -i 's/input\.[a-z]*\.o/input.o/' $DIR/cc.mini.txt $DIR/cc.gcc.txt
+
+if ! cmp -s $DIR/input.mini.o $DIR/input.gcc.o; then
+    echo "objects differ" >> $DIR/cc.mini.txt
+fi
+
+report cc $mt $gt $(text_size $DIR/cc.mini.o) $(text_size $DIR/cc.gcc.o) "$(compare cc)"
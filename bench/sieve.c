@@ -0,0 +1,37 @@
+//make bench-run: loops over an array. The elements are words, not bytes,
+//and only hold 0 or 1 so that gcc's 4 byte int sees the same thing.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main () {
+    int n = 2000000;
+    int* composite = calloc(n + 1, 8);
+    int count = 0;
+    int round = 0;
+    int i = 0;
+    int j = 0;
+
+    for (round = 0; round < 10; round++) {
+        count = 0;
+
+        for (i = 2; i < n + 1; i++)
+            composite[i] = 0;
+
+        for (i = 2; i * i < n + 1; i++) {
+            if (!composite[i]) {
+                for (j = i * i; j < n + 1; j = j + i)
+                    composite[j] = 1;
+            }
+        }
+
+        for (i = 2; i < n + 1; i++) {
+            if (!composite[i])
+                count++;
+        }
+    }
+
+    free(composite);
+    printf("%d\n", count);
+    return 0;
+}
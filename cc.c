@@ -9,12 +9,38 @@
 #include <stdio.h>
 #include <stdbool.h>
 
+#include <sys/time.h>
+
+//mini-c defines _WIN32 for -mabi=ms too, and only declares these for
+//-mabi=sysv, so what uses them is left out below on Windows
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#endif
+
 void error (char* format);
+void report (int line, char* text);
+char* diag_format (char* format, char* a, char* b);
+char* skip_blanks (char* p);
+char* skip_branch (char* p, bool to_else);
 
 //No enums :(
 int PTR_SIZE = 8;
 int WORD_SIZE = 8;
 
+///目标平台的调用约定：-mabi=ms（Win64，默认）或-mabi=sysv（Linux）
+//-mabi=ms emits a PE64 console program importing msvcrt, -mabi=sysv an
+//ELF64 object to link against glibc. Both are FASM source.
+int ABI_MS = 0;
+int ABI_SYSV = 1;
+int abi = 0;
+
+///用寄存器传递的参数个数
+int ARG_REGS = 4;
+
 FILE* output;
 int token;
 
@@ -23,6 +49,65 @@ int TOKEN_IDENT = 1;
 int TOKEN_INT = 2;
 int TOKEN_CHAR = 3;
 int TOKEN_STR = 4;
+int TOKEN_EOF = 5;
+
+//Keywords
+int TOKEN_KW_IF = 10;
+int TOKEN_KW_ELSE = 11;
+int TOKEN_KW_WHILE = 12;
+int TOKEN_KW_DO = 13;
+int TOKEN_KW_FOR = 14;
+int TOKEN_KW_RETURN = 15;
+int TOKEN_KW_INT = 16;
+int TOKEN_KW_CHAR = 17;
+int TOKEN_KW_BOOL = 18;
+int TOKEN_KW_VOID = 19;
+int TOKEN_KW_FILE = 20;
+int TOKEN_KW_TRUE = 21;
+int TOKEN_KW_FALSE = 22;
+
+//Operators and punctuation
+int TOKEN_LPAREN = 30;
+int TOKEN_RPAREN = 31;
+int TOKEN_LBRACKET = 32;
+int TOKEN_RBRACKET = 33;
+int TOKEN_LBRACE = 34;
+int TOKEN_RBRACE = 35;
+int TOKEN_SEMI = 36;
+int TOKEN_COMMA = 37;
+int TOKEN_QUESTION = 38;
+int TOKEN_COLON = 39;
+int TOKEN_DOT = 40;
+int TOKEN_PLUS = 41;
+int TOKEN_MINUS = 42;
+int TOKEN_STAR = 43;
+int TOKEN_SLASH = 44;
+int TOKEN_PERCENT = 45;
+int TOKEN_AMP = 46;
+int TOKEN_PIPE = 47;
+int TOKEN_CARET = 48;
+int TOKEN_TILDE = 49;
+int TOKEN_BANG = 50;
+int TOKEN_ASSIGN = 51;
+int TOKEN_LESS = 52;
+int TOKEN_GREATER = 53;
+int TOKEN_INC = 54;
+int TOKEN_DEC = 55;
+int TOKEN_AND = 56;
+int TOKEN_OR = 57;
+int TOKEN_SHL = 58;
+int TOKEN_SHR = 59;
+int TOKEN_EQ = 60;
+int TOKEN_NE = 61;
+int TOKEN_LE = 62;
+int TOKEN_GE = 63;
+int TOKEN_PLUS_ASSIGN = 64;
+int TOKEN_MINUS_ASSIGN = 65;
+int TOKEN_AMP_ASSIGN = 66;
+int TOKEN_PIPE_ASSIGN = 67;
+
+///token种类的个数
+int TOKEN_KINDS = 68;
 
 ///添加类型支持
 int typ;
@@ -42,122 +127,500 @@ char* inputname;
 /// 输入文件
 FILE* input;
 
+/// 整个输入文件读入一个缓冲区，词法分析直接用指针扫描
+//The whole input is read into one zero padded buffer and scanned in place.
+char* src;
+char* src_end;
+/// 当前扫描位置
+char* cur;
+
 /// 当前行
 int curln;
-/// 当前字符
-char curch;
 
+/// 当前token是src中的一段，后面的一个字符暂时被0覆盖，next()时恢复
+//The current token is a slice of src. The byte after it is temporarily
+//overwritten with a terminator, and put back by the next call to next().
 char* buffer;
 int buflength;
+char saved_ch;
 
-char next_char () {
-    if (curch == '\n')
-        curln++;
+///next()读出的token数
+int tok_count = 0;
+
+///-fcache：每个token也记进缓存的键里，见cache_token()
+bool cache_recording = false;
+void cache_token ();
+
+///字符类型表，代替isalpha/isdigit/isalnum
+//No enums, so the character classes are ordered: anything at or above
+//CC_ALPHA may continue an identifier.
+int* char_class;
+int CC_OTHER = 0;
+int CC_SPACE = 1;
+int CC_ALPHA = 2;
+int CC_DIGIT = 3;
+
+void* renew (void* old, int cap, int size);
+void* grow (void* old, int len, int cap, int size);
 
-    curch = fgetc(input);
-    //printf("get ch:%02x\n", curch);
-    return curch;
+void class_init () {
+    int ch = 0;
+    char_class = renew(char_class, 256, WORD_SIZE);
+
+    for (ch = 'a'; ch < 'z'+1; ch++)
+        char_class[ch] = CC_ALPHA;
+
+    for (ch = 'A'; ch < 'Z'+1; ch++)
+        char_class[ch] = CC_ALPHA;
+
+    for (ch = '0'; ch < '9'+1; ch++)
+        char_class[ch] = CC_DIGIT;
+
+    char_class['_'] = CC_ALPHA;
+    char_class[' '] = CC_SPACE;
+    char_class['\t'] = CC_SPACE;
+    char_class['\r'] = CC_SPACE;
+    char_class['\n'] = CC_SPACE;
 }
-bool prev_char (char before) {
-    ungetc(curch, input);
-    curch = before;
-    return false;
+
+///token的拼写，用于关键字比较和出错信息
+char** token_spelling;
+///关键字的完美哈希表，见kw_hash()
+int* kw_table;
+///算符表：单字符，重复的双字符（++ && ...），后面跟=的双字符（+= == ...）
+//Operator tables, indexed by the first character: the single character
+//token, the doubled token (++ && ...) and the token followed by '=' (+= == ...).
+int* op_single;
+int* op_double;
+int* op_assign;
+
+///关键字的完美哈希
+//A perfect hash for the keyword set, from the length, first and last
+//characters. Adding a keyword means searching for new constants.
+int kw_hash (char* str, int length) {
+    return (length + (str[0] & 255) + ((str[length-1] & 255)*6)) & 15;
 }
 
-void eat_char ()
-{
-    //The compiler is typeless, so as a compromise indexing is done
-    //in word size jumps, and pointer arithmetic in byte jumps.
-    (buffer + buflength++)[0] = curch;
-    next_char();
+void kw_def (int kind, char* spelling) {
+    token_spelling[kind] = spelling;
+    kw_table[kw_hash(spelling, strlen(spelling))] = kind;
+}
+
+void op_def (int kind, char* spelling) {
+    int first = spelling[0] & 255;
+    token_spelling[kind] = spelling;
+
+    if (spelling[1] == 0)
+        op_single[first] = kind;
+
+    else if (spelling[1] == '=')
+        op_assign[first] = kind;
+
+    else
+        op_double[first] = kind;
+}
+
+void tok_init () {
+    token_spelling = renew(token_spelling, TOKEN_KINDS, PTR_SIZE);
+    kw_table = renew(kw_table, 16, WORD_SIZE);
+    op_single = renew(op_single, 256, WORD_SIZE);
+    op_double = renew(op_double, 256, WORD_SIZE);
+    op_assign = renew(op_assign, 256, WORD_SIZE);
+
+    token_spelling[TOKEN_OTHER] = "unknown token";
+    token_spelling[TOKEN_IDENT] = "identifier";
+    token_spelling[TOKEN_INT] = "integer";
+    token_spelling[TOKEN_CHAR] = "character";
+    token_spelling[TOKEN_STR] = "string";
+    token_spelling[TOKEN_EOF] = "end of file";
+
+    kw_def(TOKEN_KW_IF, "if");
+    kw_def(TOKEN_KW_ELSE, "else");
+    kw_def(TOKEN_KW_WHILE, "while");
+    kw_def(TOKEN_KW_DO, "do");
+    kw_def(TOKEN_KW_FOR, "for");
+    kw_def(TOKEN_KW_RETURN, "return");
+    kw_def(TOKEN_KW_INT, "int");
+    kw_def(TOKEN_KW_CHAR, "char");
+    kw_def(TOKEN_KW_BOOL, "bool");
+    kw_def(TOKEN_KW_VOID, "void");
+    kw_def(TOKEN_KW_FILE, "FILE");
+    kw_def(TOKEN_KW_TRUE, "true");
+    kw_def(TOKEN_KW_FALSE, "false");
+
+    op_def(TOKEN_LPAREN, "(");
+    op_def(TOKEN_RPAREN, ")");
+    op_def(TOKEN_LBRACKET, "[");
+    op_def(TOKEN_RBRACKET, "]");
+    op_def(TOKEN_LBRACE, "{");
+    op_def(TOKEN_RBRACE, "}");
+    op_def(TOKEN_SEMI, ";");
+    op_def(TOKEN_COMMA, ",");
+    op_def(TOKEN_QUESTION, "?");
+    op_def(TOKEN_COLON, ":");
+    op_def(TOKEN_DOT, ".");
+    op_def(TOKEN_PLUS, "+");
+    op_def(TOKEN_MINUS, "-");
+    op_def(TOKEN_STAR, "*");
+    op_def(TOKEN_SLASH, "/");
+    op_def(TOKEN_PERCENT, "%");
+    op_def(TOKEN_AMP, "&");
+    op_def(TOKEN_PIPE, "|");
+    op_def(TOKEN_CARET, "^");
+    op_def(TOKEN_TILDE, "~");
+    op_def(TOKEN_BANG, "!");
+    op_def(TOKEN_ASSIGN, "=");
+    op_def(TOKEN_LESS, "<");
+    op_def(TOKEN_GREATER, ">");
+    op_def(TOKEN_INC, "++");
+    op_def(TOKEN_DEC, "--");
+    op_def(TOKEN_AND, "&&");
+    op_def(TOKEN_OR, "||");
+    op_def(TOKEN_SHL, "<<");
+    op_def(TOKEN_SHR, ">>");
+    op_def(TOKEN_EQ, "==");
+    op_def(TOKEN_NE, "!=");
+    op_def(TOKEN_LE, "<=");
+    op_def(TOKEN_GE, ">=");
+    op_def(TOKEN_PLUS_ASSIGN, "+=");
+    op_def(TOKEN_MINUS_ASSIGN, "-=");
+    op_def(TOKEN_AMP_ASSIGN, "&=");
+    op_def(TOKEN_PIPE_ASSIGN, "|=");
+}
+
+///预处理指令：只看条件编译，其余的指令当作注释
+//Only conditionals are looked at. The one name defined is _WIN32, for
+//-mabi=ms, as with the other Windows compilers. #if and #elif take only
+//0 or 1. An inactive branch is skipped a line at a time up to its #else,
+//#elif or #endif, so no state is kept between directives.
+bool is_directive (char* p, char* name) {
+    int n = strlen(name);
+    p = skip_blanks(p);
+    return strncmp(p, name, n) == 0 && char_class[p[n] & 255] < CC_ALPHA;
+}
+
+bool is_defined (char* p) {
+    p = skip_blanks(p);
+    return abi == ABI_MS && strncmp(p, "_WIN32", 6) == 0 && char_class[p[6] & 255] < CC_ALPHA;
+}
+
+char* line_end (char* p) {
+    while (p[0] != '\n' && p < src_end)
+        p++;
+
+    return p;
+}
+
+///#if或#elif：p在#后面，cond在指令名后面
+char* directive_if (char* p, char* cond) {
+    if (is_directive(cond, "0"))
+        return skip_branch(p, true);
+
+    if (!is_directive(cond, "1"))
+        report(curln, diag_format("#if and #elif only take 0 or 1", "", ""));
+
+    return line_end(p);
+}
+
+///跳过一个不用的分支，停在它的#endif（to_else时也可以是#else）那一行的末尾
+//At an #elif its condition decides again. A conditional still open at
+//the end of the file is an error, reported at the line that opened it.
+char* skip_branch (char* p, bool to_else) {
+    int depth = 0;
+    int line = curln;
+    char* at = 0;
+
+    for (p = line_end(p); p < src_end; p = line_end(p))
+    {
+        curln++;
+        p++;
+
+        //Other lines match no directive
+        at = skip_blanks(p);
+        at = at[0] == '#' ? at+1 : "";
+
+        if (is_directive(at, "if") || is_directive(at, "ifdef") || is_directive(at, "ifndef"))
+            depth++;
+
+        else if (is_directive(at, "endif") && depth == 0)
+            return line_end(at);
+
+        else if (is_directive(at, "endif"))
+            depth--;
+
+        else if (to_else && depth == 0 && is_directive(at, "else"))
+            return line_end(at);
+
+        else if (to_else && depth == 0 && is_directive(at, "elif"))
+            return directive_if(at, skip_blanks(at)+4);
+    }
+
+    report(line, diag_format("unterminated conditional", "", ""));
+    return p;
 }
 
+///p在#后面，返回这一行（或者跳过的分支）的末尾
+char* directive (char* p) {
+    if (is_directive(p, "if"))
+        return directive_if(p, skip_blanks(p)+2);
+
+    if (is_directive(p, "ifdef") && !is_defined(skip_blanks(p)+5))
+        return skip_branch(p, true);
+
+    if (is_directive(p, "ifndef") && is_defined(skip_blanks(p)+6))
+        return skip_branch(p, true);
+
+    //Reached from the branch that was taken
+    if (is_directive(p, "else") || is_directive(p, "elif"))
+        return skip_branch(p, false);
+
+    return line_end(p);
+}
 
 void next ()
 {
-    //Skip whitespace
-    while (curch == ' ' || curch == '\r' || curch == '\n' || curch == '\t')
-        next_char();
+    int cls = 0;
+    int first = 0;
+    int kw = 0;
+    char delimiter = 0;
 
-    //Treat preprocessor lines as line comments
-    if (   curch == '#'
-           || (curch == '/' && (next_char() == '/' || prev_char('/'))))
+    //Put back the byte that terminated the previous token
+    cur[0] = saved_ch;
+
+    //Skip whitespace, and treat preprocessor lines as line comments
+    while (   char_class[cur[0] & 255] == CC_SPACE || cur[0] == '#'
+           || (cur[0] == '/' && cur[1] == '/'))
     {
-        //printf("comment...%d\n", curln);
-        while (curch != '\n' && !feof(input))
-            next_char();
+        if (char_class[cur[0] & 255] == CC_SPACE)
+        {
+            if (cur[0] == '\n')
+                curln++;
 
-        //Restart the function (to skip subsequent whitespace, comments and pp)
-        next();
-        return;
+            cur++;
+        }
+        else if (cur[0] == '#')
+            cur = directive(cur+1);
+
+        else
+            cur = line_end(cur);
     }
 
-    buflength = 0;
+    buffer = cur;
     token = TOKEN_OTHER;
+    cls = char_class[cur[0] & 255];
+
+    if (cur >= src_end)
+        token = TOKEN_EOF;
+
+    //Identifier or keyword
+    else if (cls == CC_ALPHA)
+    {
+        token = TOKEN_IDENT;
+
+        while (char_class[cur[0] & 255] >= CC_ALPHA)
+            cur++;
+
+    //Integer literal
+    } else if (cls == CC_DIGIT)
+    {
+        token = TOKEN_INT;
+
+        while (char_class[cur[0] & 255] == CC_DIGIT)
+            cur++;
 
-    //Identifier, keyword or integer literal
-    if (isalpha(curch) || isdigit(curch))
+    //String or character literal
+    } else if (cur[0] == '\'' || cur[0] == '"')
     {
-        token = isalpha(curch) ? TOKEN_IDENT : TOKEN_INT;
+        token = cur[0] == '"' ? TOKEN_STR : TOKEN_CHAR;
+        delimiter = cur[0];
+        cur++;
+
+        while (cur[0] != delimiter && cur < src_end)
+        {
+            if (cur[0] == '\\')
+                cur++;
 
-        while (token == TOKEN_IDENT ? (isalnum(curch) || curch == '_') && !feof(input)
-               : isdigit(curch) && !feof(input))
-            eat_char();
+            if (cur[0] == '\n')
+                curln++;
 
-        //String or character literal
-    } else if (curch == '\'' || curch == '"')
+            cur++;
+        }
+
+        cur++;
+
+    //Operators, up to two characters
+    } else
     {
-        token = curch == '"' ? TOKEN_STR : TOKEN_CHAR;
-        //Can't retrieve this from the buffer - mini-c only has int reads
-        char delimiter = curch;
-        eat_char();
+        first = cur[0] & 255;
+        token = op_single[first];
+        cur++;
 
-        while (curch != delimiter && !feof(input))
+        if (cur[0] == buffer[0] && op_double[first])
         {
-            if (curch == '\\')
-                eat_char();
+            token = op_double[first];
+            cur++;
 
-            eat_char();
+        } else if (cur[0] == '=' && op_assign[first])
+        {
+            token = op_assign[first];
+            cur++;
         }
+    }
 
-        eat_char();
+    buflength = cur - buffer;
+    saved_ch = cur[0];
+    cur[0] = 0;
 
-        //Two char operators
-    } else if (   curch == '+' || curch == '-' || curch == '|' || curch == '&'
-                  || curch == '=' || curch == '!' || curch == '>' || curch == '<')
+    //Keywords are classified once, here
+    if (token == TOKEN_IDENT)
     {
-        eat_char();
+        kw = kw_table[kw_hash(buffer, buflength)];
 
-        if ((curch == buffer[0] && curch != '!') || curch == '=')
-            eat_char();
+        if (kw && !strcmp(token_spelling[kw], buffer))
+            token = kw;
+    }
 
-    } else
-        eat_char();
+    tok_count++;
 
-    (buffer + buflength++)[0] = 0;
+    if (cache_recording)
+        cache_token();
 }
 
-void lex_init (char* filename, int maxlen)
+void diag_init ();
+
+///源代码已经在src里：开始新的一次编译
+void lex_start (char* name, int length)
 {
-    inputname = filename;
-    input = fopen(filename, "r");
-    printf("input:%08x\n",input);
+    inputname = name;
+    src_end = src + length;
+    cur = src;
+    saved_ch = cur[0];
+
     //Get the lexer into a usable state for the parser
     curln = 1;
-    buffer = malloc(maxlen);
-    next_char();
+    tok_count = 0;
+    diag_init();
+    class_init();
+    tok_init();
     next();
 }
 
+///放源代码的缓冲区，上一次编译的不再需要
+char* lex_buffer (int length) {
+    free(src);
+
+    //The padding lets the scanner look past the end without checking
+    src = calloc(length+16, 1);
+    return src;
+}
+
+bool lex_init (char* filename)
+{
+    int length = 0;
+
+    input = fopen(filename, "rb");
+
+    if (!input) {
+        report(0, diag_format("cannot open %s", filename, ""));
+        return false;
+    }
+
+    //SEEK_END, SEEK_SET
+    fseek(input, 0, 2);
+    length = ftell(input);
+    fseek(input, 0, 0);
+
+    length = fread(lex_buffer(length), 1, length, input);
+    fclose(input);
+
+    lex_start(filename, length);
+    return true;
+}
+
+///从内存中的源代码编译，不读文件
+void lex_source (char* name, char* text, int length) {
+    memcpy(lex_buffer(length), text, length);
+    lex_start(name, length);
+}
+
 //==== Parser helper functions ====
 
 int errors;
 
-void error (char* format) {
-    printf("%s:%d: error: ", inputname, curln);
+///诊断信息按出现的顺序记下来：行号（0表示不在某一行）和文本
+//Each is also printed as it happens, unless the compiler is being used
+//as a library, where the caller reads them back instead.
+int* diag_line;
+char** diag_text;
+int diag_no = 0;
+int diag_cap = 0;
+
+bool diag_quiet = false;
+
+///输出文件名，不在某一行的错误（链接、汇编）用它开头
+char* outputname;
+
+void diag_init () {
+    int i = 0;
+
+    for (i = 0; i < diag_no; i++)
+        free(diag_text[i]);
+
+    errors = 0;
+    diag_no = 0;
+}
+
+///格式化一条诊断，最多两个%s
+char* diag_format (char* format, char* a, char* b) {
+    char* text = malloc(strlen(format) + strlen(a) + strlen(b) + 1);
+    int n = 0;
+
     //Accepting an untrusted format string? Naughty!
-    printf(format, buffer);
+    sprintf(text, format, a, b);
+
+    n = strlen(text);
+
+    if (n > 0 && text[n-1] == '\n')
+        text[n-1] = 0;
+
+    return text;
+}
+
+char* diag_number (char* format, int n) {
+    char* text = malloc(strlen(format) + 24);
+    sprintf(text, format, n);
+    return text;
+}
+
+///报告一个错误，text由这里接管
+void report (int line, char* text) {
+    if (diag_no == diag_cap)
+    {
+        diag_line = grow(diag_line, diag_no, diag_cap + diag_cap + 16, WORD_SIZE);
+        diag_text = grow(diag_text, diag_no, diag_cap + diag_cap + 16, PTR_SIZE);
+        diag_cap = diag_cap + diag_cap + 16;
+    }
+
+    diag_line[diag_no] = line;
+    diag_text[diag_no] = text;
+    diag_no++;
     errors++;
+
+    if (diag_quiet)
+        return;
+
+    if (line)
+        printf("%s:%d: error: %s\n", inputname, line, text);
+
+    else if (outputname)
+        printf("%s: error: %s\n", outputname, text);
+
+    else
+        printf("error: %s\n", text);
+}
+
+void error (char* format) {
+    report(curln, diag_format(format, buffer, ""));
 }
 
 void require (bool condition, char* format) {
@@ -165,24 +628,23 @@ void require (bool condition, char* format) {
         error(format);
 }
 
-bool see (char* look) {
-    return !strcmp(buffer, look);
+bool see (int look) {
+    return token == look;
 }
 
-bool waiting_for (char* look) {
-    return !see(look) && !feof(input);
+bool waiting_for (int look) {
+    return !see(look) && token != TOKEN_EOF;
 }
 
-void must_match (char* look) {
+void must_match (int look) {
     if (!see(look)) {
-        printf("%s:%d: error: expected '%s', found '%s'\n", inputname, curln, look, buffer);
-        errors++;
+        report(curln, diag_format("expected '%s', found '%s'", token_spelling[look], buffer));
     }
 
     next();
 }
 
-bool try_match (char* look) {
+bool try_match (int look) {
     bool saw = see(look);
 
     if (saw)
@@ -191,816 +653,6367 @@ bool try_match (char* look) {
     return saw;
 }
 
-//==== Symbol table ====
+//==== Statistics ====
+
+///--stats：各阶段的时间和各种计数，编译完打印出来；--stats=json打印成一行JSON
+//The counters are plain increments, always on. The clock is only read
+//with --stats, and then a few times per function at most.
+int STATS_OFF = 0;
+int STATS_TEXT = 1;
+int STATS_JSON = 2;
+int stats = 0;
+
+///各阶段的微秒数
+int stats_lex = 0;
+int stats_parse = 0;
+int stats_emit = 0;
+int stats_output = 0;
+
+///gettimeofday和getrusage写到这里，按字节读出来，gcc和mini-c读的一样
+void* stats_buf;
+char* stats_bytes;
+
+int stats_epoch = 0;
+bool stats_started = false;
+
+void stats_init () {
+    stats_lex = 0;
+    stats_parse = 0;
+    stats_emit = 0;
+    stats_output = 0;
+
+    //Big enough for a struct rusage
+    free(stats_buf);
+    stats_buf = calloc(32, WORD_SIZE);
+    stats_bytes = stats_buf;
+}
 
+///从at开始的n个字节，小端
+int stats_le (int at, int n) {
+    int value = 0;
+    int i = 0;
 
-///全局变量字符串指针的指针列表
-char** globals;
-/// 和globals数量一致，代表是否是函数
-bool* is_fn;
-int* globals_type;
+    for (i = n-1; i >= 0; i--)
+        value = value*256 + (stats_bytes[at+i] & 255);
 
-///是否外部，如果是外部，则间接调用。内部的则直接调用
-bool* is_extern;
-bool curr_is_extern=false;
-///全局变量初始值，以整数的形式提供
-int* globals_init_val;
-/// 全局函数/变量的 个数
-int global_no = 0;
+    return value;
+}
 
+#ifdef _WIN32
+///Windows上没有时钟和内存的统计，都是0
+int stats_clock () {
+    return 0;
+}
 
-///局部变量的字符串指针的列表
-char** locals;
-/// 局部变量在栈中的偏移量，和locals长度一致。
-int* offsets;
-int* locals_type;
+int stats_peak () {
+    return 0;
+}
+#else
+///微秒数，从第一次读的那一秒开始
+//The seconds are kept mod 2^24, so this fits in the 32 bit int of the
+//gcc build too. Where there is no clock, everything reads 0.
+int stats_clock () {
+    int sec = 0;
 
-/// 局部变量个数
-int local_no = 0;
-int param_no = 0;
+    gettimeofday(stats_buf, 0);
+    sec = stats_le(0, 3);
+
+    if (!stats_started)
+    {
+        stats_epoch = sec;
+        stats_started = true;
+    }
+
+    return (((sec - stats_epoch) & 16777215) * 1000000) + stats_le(8, 3);
+}
+
+///最大常驻内存，KB；RUSAGE_SELF，ru_maxrss在两个timeval之后
+int stats_peak () {
+    if (getrusage(0, stats_buf) != 0)
+        return 0;
+
+    return stats_le(32, 4);
+}
+#endif
 
+//==== Assembly output ====
 
+///生成的代码都写到一个大缓冲区里，在函数之间整块写到文件
+//All generated code is appended to one large buffer, which is written
+//to the file in big blocks between functions. While a function is being
+//generated its text stays in memory, so that it can be taken back and
+//rewritten (prologue placement, peephole). Integers are formatted here
+//rather than by printf.
+char* out_buf;
+int out_len = 0;
+int out_cap = 0;
 
-///字符串常量
-char **const_strs;
-int *const_strs_label;
-///字符串常量的个数
-int const_strs_no = 0;
+///没有输出文件时（作为库调用），结果写到这里
+char* out_mem;
+int out_mem_len = 0;
+int out_mem_cap = 0;
 
-void sym_init (int max) {
-    globals = malloc(PTR_SIZE*max);
-    globals_type = calloc(max, PTR_SIZE);
-    globals_init_val = calloc(max, PTR_SIZE);
-    is_fn = calloc(max, PTR_SIZE);
-    is_extern = calloc(max, PTR_SIZE);
+///写出去的字节数
+int out_written = 0;
 
-    locals = malloc(PTR_SIZE*max);
-    locals_type=calloc(max, WORD_SIZE);
-    offsets = calloc(max, WORD_SIZE);
+///取回的文本放在这里，只在需要时变大
+char* out_spare;
+int out_spare_cap = 0;
 
-    const_strs=malloc(PTR_SIZE*max);
-    const_strs_label = calloc(max, WORD_SIZE);
+int OUT_BLOCK = 1048576;
+
+///10的幂，用来不做除法地输出十进制
+int* powers_of_ten;
+
+void out_init () {
+    int i = 0;
+
+    free(out_buf);
+    out_len = 0;
+    out_cap = OUT_BLOCK;
+    out_buf = malloc(out_cap + 1);
+    out_mem_len = 0;
+    out_written = 0;
+
+    powers_of_ten = renew(powers_of_ten, 10, WORD_SIZE);
+    powers_of_ten[0] = 1;
+
+    for (i = 1; i < 10; i++)
+        powers_of_ten[i] = powers_of_ten[i-1]*10;
 }
 
-void new_global (char* ident)
-{
-    globals_type[global_no] = typ;
-    globals[global_no++] = ident;
+void out_reserve (int n) {
+    char* old = out_buf;
+
+    if (out_len + n > out_cap)
+    {
+        while (out_len + n > out_cap)
+            out_cap = out_cap + out_cap;
+
+        out_buf = malloc(out_cap + 1);
+        old[out_len] = 0;
+        strcpy(out_buf, old);
+        free(old);
+    }
 }
 
-void new_fn (char* ident, int is_ext)
-{
-    fprintf(output,";func:%s-%d\n", ident, is_ext);
-    is_fn[global_no] = true;
-    is_extern[global_no]=is_ext;
-    new_global(ident);
+///-c：文本不写出去，而是汇编成目标文件
+bool obj_mode = false;
+
+///--run：汇编到内存里直接执行，不写任何文件
+bool run_mode = false;
+
+void asm_text (char* text);
+
+///写到输出文件，或者内存
+void out_write (char* data, int n) {
+    out_written = out_written + n;
+
+    if (output)
+        fwrite(data, 1, n, output);
+
+    else
+    {
+        if (out_mem_len + n > out_mem_cap)
+        {
+            while (out_mem_len + n > out_mem_cap)
+                out_mem_cap = out_mem_cap + out_mem_cap + OUT_BLOCK;
+
+            out_mem = grow(out_mem, out_mem_len, out_mem_cap, 1);
+        }
+
+        memcpy(out_mem + out_mem_len, data, n);
+        out_mem_len = out_mem_len + n;
+    }
 }
 
-int new_local (char* ident)
-{
-    int var_index = local_no - param_no;
+///在函数之间调用：缓冲区满了一块就写出去
+void out_flush (bool all) {
+    int start = 0;
 
-    locals[local_no] = ident;
-    locals_type[local_no] = typ;
-    //The first local variable is directly below the base pointer
-    offsets[local_no] = -WORD_SIZE*(var_index+1);
-    fprintf(output, ";new local:%s. type=%d\n", ident, typ);
-    return local_no++;
+    if (out_len > 0 && (all || out_len >= OUT_BLOCK))
+    {
+        if (stats)
+            start = stats_clock();
+
+        out_buf[out_len] = 0;
+
+        if (obj_mode)
+            asm_text(out_buf);
+        else
+            out_write(out_buf, out_len);
+
+        out_len = 0;
+
+        if (stats)
+            stats_output = stats_output + stats_clock() - start;
+    }
 }
 
-void new_param (char* ident) {
-    int local = new_local(ident);
+///从start开始的文本取出来，之后可以重新写入
+char* out_take (int start) {
+    int n = out_len - start;
 
-    //At and above the base pointer, in order, are:
-    // 1. the old base pointer, [ebp]
-    // 2. the return address, [ebp+W]
-    // 3. the first parameter, [ebp+2W]
-    //   and so on
-    offsets[local] = WORD_SIZE*(2 + param_no++);
+    if (n + 1 > out_spare_cap)
+    {
+        if (out_spare_cap)
+            free(out_spare);
+
+        out_spare_cap = n + n + 1;
+        out_spare = malloc(out_spare_cap);
+    }
+
+    out_buf[out_len] = 0;
+    strcpy(out_spare, out_buf + start);
+    out_len = start;
+    return out_spare;
 }
 
-//Enter the scope of a new function
-void new_scope () {
-    local_no = 0;
-    param_no = 0;
+void emit (char* text) {
+    int n = strlen(text);
+
+    out_reserve(n);
+    strcpy(out_buf + out_len, text);
+    out_len = out_len + n;
+}
+
+void emit_char (char c) {
+    out_reserve(1);
+    out_buf[out_len] = c;
+    out_len++;
 }
 
-int sym_lookup (char** table, int table_size, char* look) {
+///十进制写到p，至少width位，不够补0；返回写完的位置
+//No division in mini-c: each digit counts how many times its power of
+//ten can be subtracted
+char* put_digits (char* p, int n, int width) {
     int i = 0;
+    int digit = 0;
+    bool started = false;
 
-    while (i < table_size)
-        if (!strcmp(table[i++], look))
-            return i-1;
+    if (n < 0)
+    {
+        p[0] = '-';
+        p++;
+        n = -n;
+    }
 
-    return -1;
-}
+    for (i = 9; i >= 0; i--)
+    {
+        digit = 0;
 
-//==== Codegen labels ====
+        while (n >= powers_of_ten[i]) {
+            n = n - powers_of_ten[i];
+            digit++;
+        }
 
-int label_no = 0;
+        if (started || digit || i < width)
+        {
+            p[0] = '0' + digit;
+            p++;
+            started = true;
+        }
+    }
 
-/// 1个函数有2个label，一个开始，一个结束。所有的return都跳到结束的label处
-//The label to jump to on `return`
-int return_to;
+    return p;
+}
 
-int new_label () {
-    return label_no++;
+char* put_text (char* p, char* text) {
+    strcpy(p, text);
+    return p + strlen(text);
 }
 
-int emit_label (int label) {
-    fprintf(output, "_%08d:\n", label);
-    return label;
+char* put_disp (char* p, int n) {
+    if (n >= 0)
+        p = put_text(p, "+");
+
+    return put_digits(p, n, 1);
 }
 
-//==== One-pass parser and code generator ====
+void emit_digits (int n, int width) {
+    out_reserve(12);
+    out_len = put_digits(out_buf + out_len, n, width) - out_buf;
+}
 
-bool lvalue;
+void emit_int (int n) {
+    emit_digits(n, 1);
+}
 
-void needs_lvalue (char* msg) {
-    if (!lvalue)
-        error(msg);
+///带符号的偏移，[rbp-8]、[rsp+16]
+void emit_disp (int n) {
+    if (n >= 0)
+        emit_char('+');
 
-    lvalue = false;
+    emit_int(n);
 }
 
-void expr (int level);
+void emit_label_ref (int label) {
+    emit_char('_');
+    emit_digits(label, 8);
+}
 
-int char_preprocess(char* buf)
-{
+///-fpeephole时，函数体的指令不写成文本，直接放进指令缓存
+//Set between peep_begin and peep_end. The helpers below then add a record
+//with the operands as separate strings, which the peephole rules match
+//without splitting lines again.
+bool ins_capture = false;
+
+void ins_add (char* name, char* a, char* b);
+void ins_label (char* name);
+void ins_note (char* text);
+char* ins_space (int n);
+char* ins_keep (char* end);
+char* ins_copy (char* s);
+char* ins_number (int n);
+char* ins_mem (char* base, int off);
+char* ins_join (char* a, char* b);
+
+char* ins_label_ref (int label) {
+    char* p = put_text(ins_space(12), "_");
+    return ins_keep(put_digits(p, label, 8));
+}
 
+///op a, b  （b或a为0时省略）
+void emit_ins (char* op, char* a, char* b) {
+    int n = strlen(op);
+    int na = a ? strlen(a) : 0;
+    int nb = b ? strlen(b) : 0;
+    char* p = 0;
 
-    ///特殊字符处理
-    //if(strncmp(buf+1,"n",1)==0)
-    if(buf[1]=='n')
+    if (ins_capture)
     {
-        return '\n';
+        ins_add(op, ins_copy(a), ins_copy(b));
+        return;
     }
-    else if(buf[1]=='r') //if(strncmp(buf+1,"r",1)==0)
+
+    //The whole line in one go, most instructions come through here
+    out_reserve(n + na + nb + 4);
+    p = out_buf + out_len;
+    memcpy(p, op, n);
+    p = p + n;
+
+    if (a)
     {
-        return '\r';
+        p[0] = ' ';
+        memcpy(p + 1, a, na);
+        p = p + 1 + na;
     }
-    else if(buf[1]=='t')//if(strncmp(buf+1,"t",1)==0)
+
+    if (b)
     {
-        return '\t';
+        p[0] = ',';
+        p[1] = ' ';
+        memcpy(p + 2, b, nb);
+        p = p + 2 + nb;
     }
-    else if(buf[1]=='0')// if(strncmp(buf+1,"0",1)==0)
+
+    p[0] = '\n';
+    out_len = p + 1 - out_buf;
+}
+
+///op a, 立即数
+void emit_imm (char* op, char* a, int imm) {
+    if (ins_capture)
     {
-        return '\0';
+        ins_add(op, ins_copy(a), ins_number(imm));
+        return;
     }
-    else if(buf[1]=='\\') //if(strncmp(buf+1,"\\",1)==0)
+
+    emit(op);
+    emit_char(' ');
+    emit(a);
+    emit(", ");
+    emit_int(imm);
+    emit_char('\n');
+}
+
+///op reg, [base+off]
+void emit_load (char* op, char* reg, char* base, int off) {
+    if (ins_capture)
     {
-        return '\\';
+        ins_add(op, ins_copy(reg), ins_mem(base, off));
+        return;
     }
-    else if(buf[1]=='\'')//if(strncmp(buf+1,"'",1)==0)
+
+    emit(op);
+    emit_char(' ');
+    emit(reg);
+    emit(", [");
+    emit(base);
+    emit_disp(off);
+    emit("]\n");
+}
+
+///mov [base+off], reg
+void emit_save (char* base, int off, char* reg) {
+    if (ins_capture)
     {
-        return '\'';
+        ins_add("mov", ins_mem(base, off), ins_copy(reg));
+        return;
     }
-    else if(buf[1]=='x')//if(strncmp(buf+1,"x",1)==0)
-    {
-        return 255;//atoi(buf+2); FIXME .此处只有1个字符，就是\xff
+
+    emit("mov [");
+    emit(base);
+    emit_disp(off);
+    emit("], ");
+    emit(reg);
+    emit_char('\n');
+}
+
+///op rax, [index*scale+base]
+void emit_scaled (char* op, char* index, int scale, char* base) {
+    char* p = 0;
+
+    if (ins_capture)
+    {
+        p = put_text(ins_space(strlen(index) + strlen(base) + 16), "[");
+        p = put_text(p, index);
+        p = put_text(p, "*");
+        p = put_digits(p, scale, 1);
+        p = put_text(p, "+");
+        p = put_text(p, base);
+        ins_add(op, "rax", ins_keep(put_text(p, "]")));
+        return;
+    }
+
+    emit(op);
+    emit(" rax, [");
+    emit(index);
+    emit_char('*');
+    emit_int(scale);
+    emit_char('+');
+    emit(base);
+    emit("]\n");
+}
+
+///op rax, [index*scale+rbp+off]，局部数组的元素
+void emit_scaled_local (char* op, char* index, int scale, int off) {
+    char* p = 0;
+
+    if (ins_capture)
+    {
+        p = put_text(ins_space(strlen(index) + 32), "[");
+        p = put_text(p, index);
+        p = put_text(p, "*");
+        p = put_digits(p, scale, 1);
+        p = put_text(p, "+rbp");
+        p = put_disp(p, off);
+        ins_add(op, "rax", ins_keep(put_text(p, "]")));
+        return;
+    }
+
+    emit(op);
+    emit(" rax, [");
+    emit(index);
+    emit_char('*');
+    emit_int(scale);
+    emit("+rbp");
+    emit_disp(off);
+    emit("]\n");
+}
+
+///op reg, [name]
+void emit_sym (char* op, char* reg, char* name) {
+    char* p = 0;
+
+    if (ins_capture)
+    {
+        p = put_text(ins_space(strlen(name) + 2), "[");
+        p = put_text(p, name);
+        p = ins_keep(put_text(p, "]"));
+        ins_add(op, ins_copy(reg), p);
+        return;
+    }
+
+    emit(op);
+    emit_char(' ');
+    emit(reg);
+    emit(", [");
+    emit(name);
+    emit("]\n");
+}
+
+///lea reg, [_label]
+void emit_label_addr (char* reg, int label) {
+    char* p = 0;
+
+    if (ins_capture)
+    {
+        p = put_text(ins_space(14), "[_");
+        p = put_digits(p, label, 8);
+        p = ins_keep(put_text(p, "]"));
+        ins_add("lea", ins_copy(reg), p);
+        return;
+    }
+
+    emit("lea ");
+    emit(reg);
+    emit(", [");
+    emit_label_ref(label);
+    emit("]\n");
+}
+
+void emit_jump (char* op, int label) {
+    if (ins_capture)
+    {
+        ins_add(op, ins_label_ref(label), 0);
+        return;
+    }
+
+    emit(op);
+    emit_char(' ');
+    emit_label_ref(label);
+    emit_char('\n');
+}
+
+//==== Memory ====
+
+///一次编译只有一个内存池：名字这样一直要用的小块从大块中依次切出，从不单独释放
+//Small allocations that live for the whole compilation, like the
+//interned names, are carved from big chunks instead of a malloc each.
+char* arena;
+int arena_used = 0;
+int arena_size = 0;
+
+int ARENA_CHUNK = 65536;
+
+///所有的块，编译完一起释放
+char** arena_chunks;
+int arena_chunk_no = 0;
+int arena_chunk_cap = 0;
+
+///mini-c把bool当成一个字来读写
+int BOOL_SIZE = 8;
+
+void* grow (void* old, int len, int cap, int size);
+
+char* arena_alloc (int size) {
+    char* p = 0;
+
+    //Keep the next one word aligned
+    size = (size + 7) & -8;
+
+    if (arena_used + size > arena_size)
+    {
+        arena_size = size > ARENA_CHUNK ? size : ARENA_CHUNK;
+        arena = malloc(arena_size);
+        arena_used = 0;
+
+        //Remembered for arena_reset
+        if (arena_chunk_no == arena_chunk_cap)
+        {
+            arena_chunks = grow(arena_chunks, arena_chunk_no, arena_chunk_cap + arena_chunk_cap + 16, PTR_SIZE);
+            arena_chunk_cap = arena_chunk_cap + arena_chunk_cap + 16;
+        }
+
+        arena_chunks[arena_chunk_no++] = arena;
+    }
+
+    p = arena + arena_used;
+    arena_used = arena_used + size;
+    return p;
+}
+
+///下一次编译之前，把所有块都还回去
+void arena_reset () {
+    int i = 0;
+
+    for (i = 0; i < arena_chunk_no; i++)
+        free(arena_chunks[i]);
+
+    arena_chunk_no = 0;
+    arena_used = 0;
+    arena_size = 0;
+}
+
+char* arena_strdup (char* str) {
+    char* p = arena_alloc(strlen(str) + 1);
+    strcpy(p, str);
+    return p;
+}
+
+///重新开始的数组：旧的（可能还没有）释放，新的清零
+void* renew (void* old, int cap, int size) {
+    free(old);
+    return calloc(cap, size);
+}
+
+///数组变大到cap个元素，保留前len个
+void* grow (void* old, int len, int cap, int size) {
+    char* p = calloc(cap, size);
+    memcpy(p, old, len*size);
+    free(old);
+    return p;
+}
+
+//==== Symbol table ====
+
+
+///符号表是一个开放寻址的哈希表，以名字为键。每个名字只保存一份（驻留），
+///同一个符号同时保存该名字的全局定义和当前函数中的局部定义。
+//The symbol table is an open addressing hash table keyed on interned names.
+//A symbol holds both the global and the local binding of its name, so one
+//probe resolves an identifier, and locals shadow globals for free.
+//Symbols are numbered densely and the per-symbol arrays grow with them;
+//the hash table only maps names to numbers, so it can be rebuilt.
+
+///槽位的个数，2的幂，最多半满；槽位里是符号编号+1
+int* sym_slots;
+int sym_slots_cap;
+
+///符号个数，和各个按符号编号的数组的容量
+int sym_no = 0;
+int sym_cap;
+
+///驻留的名字
+char** sym_name;
+int* sym_hash;
+
+///全局定义
+bool* sym_global;
+/// 代表是否是函数
+bool* sym_is_fn;
+///是否外部，如果是外部，则间接调用。内部的则直接调用
+bool* sym_is_extern;
+int* sym_global_type;
+///全局变量初始值，整数字面量的原文，没有时为0
+//The text, since a wide one does not fit the compiler's int under gcc
+char** sym_init_text;
+
+///局部定义，只有sym_scope等于当前的scope_no时才有效
+//A local binding is only live while its scope number is the current one,
+//which makes leaving a function O(1).
+int* sym_scope;
+/// 局部变量在栈中的偏移量
+int* sym_offset;
+int* sym_local_type;
+///局部数组：它的值是第一个元素的地址，不能赋值
+bool* sym_is_array;
+
+int scope_no = 1;
+
+///直接调用的函数，-1表示通过rax中的地址调用
+//Set by factor() when a function name is followed by '(', so that
+//object() can call it by name instead of loading its address
+int direct_callee = 0;
+
+///下标直接相对rbp的局部数组，-1表示数组的地址在rax中
+int direct_array = 0;
+
+///全局函数/变量，按声明顺序
+int* global_syms;
+/// 全局函数/变量的 个数
+int global_no = 0;
+int global_cap = 0;
+
+/// 局部变量个数
+int local_no = 0;
+int param_no = 0;
+///当前函数的局部数组个数
+int array_no = 0;
+
+///查找次数和比较次数
+int sym_lookups = 0;
+int sym_probes = 0;
+
+
+///其它部分按符号编号的数组，在它们各自的地方
+void fold_grow (int len, int cap);
+void regalloc_grow (int len, int cap);
+void obj_grow (int len, int cap);
+void cache_grow (int len, int cap);
+
+void sym_init (int max) {
+    //The names of the last compilation go with it
+    arena_reset();
+
+    sym_no = 0;
+    scope_no = 1;
+    direct_callee = 0;
+    global_no = 0;
+    local_no = 0;
+    param_no = 0;
+    sym_lookups = 0;
+    sym_probes = 0;
+
+    sym_cap = max;
+    sym_slots_cap = 1;
+
+    while (sym_slots_cap < max*2)
+        sym_slots_cap = sym_slots_cap*2;
+
+    sym_slots = renew(sym_slots, sym_slots_cap, WORD_SIZE);
+
+    sym_name = renew(sym_name, sym_cap, PTR_SIZE);
+    sym_hash = renew(sym_hash, sym_cap, WORD_SIZE);
+
+    sym_global = renew(sym_global, sym_cap, BOOL_SIZE);
+    sym_is_fn = renew(sym_is_fn, sym_cap, BOOL_SIZE);
+    sym_is_extern = renew(sym_is_extern, sym_cap, BOOL_SIZE);
+    sym_global_type = renew(sym_global_type, sym_cap, WORD_SIZE);
+    sym_init_text = renew(sym_init_text, sym_cap, PTR_SIZE);
+
+    sym_scope = renew(sym_scope, sym_cap, WORD_SIZE);
+    sym_offset = renew(sym_offset, sym_cap, WORD_SIZE);
+    sym_local_type = renew(sym_local_type, sym_cap, WORD_SIZE);
+    sym_is_array = renew(sym_is_array, sym_cap, BOOL_SIZE);
+
+    global_cap = max;
+    global_syms = renew(global_syms, global_cap, WORD_SIZE);
+}
+
+void sym_grow () {
+    int cap = sym_cap*2;
+
+    sym_name = grow(sym_name, sym_no, cap, PTR_SIZE);
+    sym_hash = grow(sym_hash, sym_no, cap, WORD_SIZE);
+
+    sym_global = grow(sym_global, sym_no, cap, BOOL_SIZE);
+    sym_is_fn = grow(sym_is_fn, sym_no, cap, BOOL_SIZE);
+    sym_is_extern = grow(sym_is_extern, sym_no, cap, BOOL_SIZE);
+    sym_global_type = grow(sym_global_type, sym_no, cap, WORD_SIZE);
+    sym_init_text = grow(sym_init_text, sym_no, cap, PTR_SIZE);
+
+    sym_scope = grow(sym_scope, sym_no, cap, WORD_SIZE);
+    sym_offset = grow(sym_offset, sym_no, cap, WORD_SIZE);
+    sym_local_type = grow(sym_local_type, sym_no, cap, WORD_SIZE);
+    sym_is_array = grow(sym_is_array, sym_no, cap, BOOL_SIZE);
+
+    fold_grow(sym_no, cap);
+    regalloc_grow(sym_no, cap);
+    obj_grow(sym_no, cap);
+    cache_grow(sym_no, cap);
+    sym_cap = cap;
+}
+
+int hash_str (char* str) {
+    int hash = 0;
+    int i = 0;
+
+    //Kept to 24 bits so it never overflows, in either compiler
+    while (str[i] != 0)
+        hash = (hash*31 + (str[i++] & 255)) & 16777215;
+
+    return hash;
+}
+
+///返回名字所在的槽位，没有的话返回它应该在的空槽位
+int sym_slot (char* look, int hash) {
+    int slot = hash & (sym_slots_cap-1);
+    int sym = sym_slots[slot] - 1;
+
+    sym_lookups++;
+
+    while (sym >= 0 && (sym_hash[sym] != hash || strcmp(sym_name[sym], look)))
+    {
+        sym_probes++;
+        slot = (slot+1) & (sym_slots_cap-1);
+        sym = sym_slots[slot] - 1;
+    }
+
+    return slot;
+}
+
+int sym_lookup (char* look) {
+    return sym_slots[sym_slot(look, hash_str(look))] - 1;
+}
+
+///哈希表满一半时加倍，符号编号不变
+void sym_rehash () {
+    int i = 0;
+    int slot = 0;
+
+    free(sym_slots);
+    sym_slots_cap = sym_slots_cap*2;
+    sym_slots = calloc(sym_slots_cap, WORD_SIZE);
+
+    for (i = 0; i < sym_no; i++)
+    {
+        slot = sym_hash[i] & (sym_slots_cap-1);
+
+        while (sym_slots[slot])
+            slot = (slot+1) & (sym_slots_cap-1);
+
+        sym_slots[slot] = i+1;
+    }
+}
+
+///驻留名字，返回它的符号编号
+int sym_intern (char* ident) {
+    int hash = hash_str(ident);
+    int slot = sym_slot(ident, hash);
+    int sym = sym_slots[slot] - 1;
+
+    if (sym < 0) {
+        if (sym_no == sym_cap)
+            sym_grow();
+
+        //Owned by the symbol table
+        sym = sym_no++;
+        sym_name[sym] = arena_strdup(ident);
+        sym_hash[sym] = hash;
+        sym_slots[slot] = sym+1;
+
+        if (sym_no*2 > sym_slots_cap)
+            sym_rehash();
+    }
+
+    return sym;
+}
+
+bool is_local (int sym) {
+    return sym >= 0 && sym_scope[sym] == scope_no;
+}
+
+bool is_global (int sym) {
+    return sym >= 0 && sym_global[sym];
+}
+
+void new_global (int sym)
+{
+    if (!sym_global[sym])
+    {
+        if (global_no == global_cap)
+        {
+            global_syms = grow(global_syms, global_no, global_cap*2, WORD_SIZE);
+            global_cap = global_cap*2;
+        }
+
+        global_syms[global_no++] = sym;
+    }
+
+    sym_global[sym] = true;
+    sym_global_type[sym] = typ;
+}
+
+void new_fn (int sym, int is_ext)
+{
+    emit(";func:");
+    emit(sym_name[sym]);
+    emit_char('-');
+    emit_int(is_ext);
+    emit_char('\n');
+    sym_is_fn[sym] = true;
+    sym_is_extern[sym]=is_ext;
+    new_global(sym);
+}
+
+///System V中寄存器参数在栈帧中的位置数
+int param_homes () {
+    if (abi == ABI_SYSV)
+        return param_no < ARG_REGS ? param_no : ARG_REGS;
+
+    return 0;
+}
+
+///栈帧中局部变量（和System V参数）占的位置数
+int local_slots () {
+    return local_no - param_no + param_homes();
+}
+
+int new_local (int sym)
+{
+    int var_index = local_slots();
+    char* p = 0;
+
+    sym_scope[sym] = scope_no;
+    sym_local_type[sym] = typ;
+    sym_is_array[sym] = false;
+    //The first local variable is directly below the base pointer
+    sym_offset[sym] = -WORD_SIZE*(var_index+1);
+
+    if (ins_capture)
+    {
+        p = put_text(ins_space(strlen(sym_name[sym]) + 32), ";new local:");
+        p = put_text(p, sym_name[sym]);
+        p = put_text(p, ". type=");
+        ins_note(ins_keep(put_digits(p, typ, 1)));
+    }
+
+    else
+    {
+        emit(";new local:");
+        emit(sym_name[sym]);
+        emit(". type=");
+        emit_int(typ);
+        emit_char('\n');
+    }
+
+    local_no++;
+    return sym;
+}
+
+///局部数组，length个元素：char的一个字节，其它的一个字
+//An array takes as many slots as its bytes need and starts at the lowest
+//of them, so its elements run up towards the base pointer. The slots are
+//words, which keeps every element aligned.
+int new_array (int sym, int length) {
+    int size = typ == TYPE_CHAR ? length : length*WORD_SIZE;
+    int slots = 1;
+
+    while (slots*WORD_SIZE < size)
+        slots++;
+
+    new_local(sym);
+    local_no = local_no + slots - 1;
+    sym_offset[sym] = -WORD_SIZE*local_slots();
+    sym_is_array[sym] = true;
+    array_no++;
+
+    ///值是元素的指针
+    if (typ == TYPE_CHAR)
+        sym_local_type[sym] = TYPE_CHAR_PTR;
+    else if (typ == TYPE_CHAR_PTR)
+        sym_local_type[sym] = TYPE_CHAR_PTR_PTR;
+    else
+        sym_local_type[sym] = TYPE_INT_PTR;
+
+    return sym;
+}
+
+///第i个参数在栈中的偏移量
+int param_offset (int i) {
+    //At and above the base pointer, in order, are:
+    // 1. the old base pointer, [ebp]
+    // 2. the return address, [ebp+W]
+    // 3. the first parameter, [ebp+2W]
+    //   and so on
+    //System V has no shadow space, so the register arguments are homed in
+    //the first slots below the base pointer, and the stack arguments start
+    //at [ebp+2W].
+    if (abi == ABI_SYSV && i < ARG_REGS)
+        return -WORD_SIZE*(i+1);
+
+    if (abi == ABI_SYSV)
+        return WORD_SIZE*(2 + i - ARG_REGS);
+
+    return WORD_SIZE*(2 + i);
+}
+
+///栈中的这个位置是否是参数的
+bool is_param_home (int offset) {
+    return offset > 0 || (offset < 0 && offset >= -WORD_SIZE*param_homes());
+}
+
+void new_param (int sym) {
+    new_local(sym);
+    sym_offset[sym] = param_offset(param_no++);
+}
+
+//Enter the scope of a new function
+void new_scope () {
+    scope_no++;
+    local_no = 0;
+    param_no = 0;
+    array_no = 0;
+}
+
+//==== Codegen labels ====
+
+int label_no = 0;
+
+/// 1个函数有2个label，一个开始，一个结束。所有的return都跳到结束的label处
+//The label to jump to on `return`
+int return_to;
+
+///当前函数是否调用了其它函数；不调用函数、也不用栈的函数不建立栈帧
+//A leaf function that needs no stack slots gets no frame: no rbp and
+//no spills of the argument registers
+bool fn_calls = false;
+bool has_frame = true;
+
+int new_label () {
+    return label_no++;
+}
+
+int emit_label (int label) {
+    if (ins_capture)
+        ins_label(ins_label_ref(label));
+
+    else
+    {
+        emit_label_ref(label);
+        emit(":\n");
+    }
+
+    return label;
+}
+
+//==== String literals ====
+
+///字符串常量池：转义只解一次，相同的字符串共用一个标号
+//Literals are decoded into one growing byte pool. Adjacent literals are
+//decoded one after the other at the end of it, which concatenates them,
+//and the result is then looked up among the earlier ones by hash.
+char* str_pool;
+int str_pool_len = 0;
+int str_pool_cap = 0;
+
+int* str_start;
+int* str_len;
+int* str_hash;
+int* str_label;
+int str_no = 0;
+int str_cap = 0;
+
+///开放定址的哈希表，存字符串编号+1，最多半满
+int* str_slots;
+int str_slots_cap = 0;
+
+int char_preprocess (char* buf);
+
+void str_init () {
+    free(str_pool);
+    str_pool_len = 0;
+    str_pool_cap = 4096;
+    str_pool = malloc(str_pool_cap);
+    str_no = 0;
+
+    str_cap = 256;
+    str_start = renew(str_start, str_cap, WORD_SIZE);
+    str_len = renew(str_len, str_cap, WORD_SIZE);
+    str_hash = renew(str_hash, str_cap, WORD_SIZE);
+    str_label = renew(str_label, str_cap, WORD_SIZE);
+
+    str_slots_cap = 512;
+    str_slots = renew(str_slots, str_slots_cap, WORD_SIZE);
+}
+
+void str_reserve (int n) {
+    char* old = str_pool;
+
+    if (str_pool_len + n > str_pool_cap)
+    {
+        while (str_pool_len + n > str_pool_cap)
+            str_pool_cap = str_pool_cap*2;
+
+        str_pool = malloc(str_pool_cap);
+        memcpy(str_pool, old, str_pool_len);
+        free(old);
+    }
+}
+
+///十六进制数字的值，不是的话返回-1
+int hex_digit (char* p) {
+    int c = p[0] & 255;
+
+    if (c >= '0' && '9' >= c)
+        return c - '0';
+
+    //Upper case
+    c = c & 223;
+
+    if (c >= 'A' && 'F' >= c)
+        return c - 'A' + 10;
+
+    return -1;
+}
+
+///转义序列的长度，包括反斜杠
+int escape_len (char* buf) {
+    int i = 2;
+
+    if (buf[1] == 'x')
+    {
+        while (i < 4 && hex_digit(buf+i) >= 0)
+            i++;
+    }
+
+    return i;
+}
+
+///把字面量（带引号的原文）解码，接在池尾
+void str_append (char* lit) {
+    int i = 1;
+    int end = strlen(lit) - 1;
+
+    str_reserve(end);
+
+    while (i < end) {
+        if (lit[i] == '\\')
+        {
+            str_pool[str_pool_len++] = char_preprocess(lit+i);
+            i = i + escape_len(lit+i);
+        }
+        else
+            str_pool[str_pool_len++] = lit[i++];
+    }
+}
+
+bool str_equal (int str, int start, int len) {
+    int i = 0;
+
+    if (str_len[str] != len)
+        return false;
+
+    for (i = 0; i < len; i++)
+    {
+        if (str_pool[str_start[str] + i] != str_pool[start + i])
+            return false;
+    }
+
+    return true;
+}
+
+int str_slot (int hash) {
+    int slot = hash & (str_slots_cap-1);
+
+    while (str_slots[slot])
+        slot = (slot+1) & (str_slots_cap-1);
+
+    return slot;
+}
+
+void str_rehash () {
+    int i = 0;
+
+    free(str_slots);
+    str_slots_cap = str_slots_cap*2;
+    str_slots = calloc(str_slots_cap, WORD_SIZE);
+
+    for (i = 0; i < str_no; i++)
+        str_slots[str_slot(str_hash[i])] = i+1;
+}
+
+///池尾从start开始的字符串：以前有过的话丢掉池尾，用原来的标号
+int str_intern (int start) {
+    int len = str_pool_len - start;
+    int hash = 0;
+    int i = 0;
+    int slot = 0;
+    int str = 0;
+
+    for (i = start; i < str_pool_len; i++)
+        hash = (hash*31 + (str_pool[i] & 255)) & 16777215;
+
+    slot = hash & (str_slots_cap-1);
+
+    while (str_slots[slot])
+    {
+        str = str_slots[slot] - 1;
+
+        if (str_hash[str] == hash && str_equal(str, start, len))
+        {
+            str_pool_len = start;
+            return str_label[str];
+        }
+
+        slot = (slot+1) & (str_slots_cap-1);
+    }
+
+    if (str_no == str_cap)
+    {
+        str_start = grow(str_start, str_no, str_cap*2, WORD_SIZE);
+        str_len = grow(str_len, str_no, str_cap*2, WORD_SIZE);
+        str_hash = grow(str_hash, str_no, str_cap*2, WORD_SIZE);
+        str_label = grow(str_label, str_no, str_cap*2, WORD_SIZE);
+        str_cap = str_cap*2;
+    }
+
+    str_start[str_no] = start;
+    str_len[str_no] = len;
+    str_hash[str_no] = hash;
+    str_label[str_no] = new_label();
+    str_slots[slot] = str_no+1;
+    str_no++;
+
+    if (str_no*2 > str_slots_cap)
+        str_rehash();
+
+    return str_label[str_no-1];
+}
+
+bool str_printable (int c) {
+    return c >= ' ' && '~' >= c && c != '\'';
+}
+
+///.rodata：可打印的字符连成'...'，其余的写成数字
+void str_emit () {
+    int i = 0;
+    int p = 0;
+    int end = 0;
+
+    for (i = 0; i < str_no; i++)
+    {
+        p = str_start[i];
+        end = p + str_len[i];
+
+        emit_label_ref(str_label[i]);
+        emit(" db ");
+
+        while (p < end) {
+            if (str_printable(str_pool[p] & 255))
+            {
+                emit_char('\'');
+
+                while (p < end && str_printable(str_pool[p] & 255))
+                    emit_char(str_pool[p++]);
+
+                emit("', ");
+            }
+            else
+            {
+                emit_int(str_pool[p++] & 255);
+                emit(", ");
+            }
+        }
+
+        emit("0\n");
+    }
+}
+
+//==== Syntax tree ====
+
+///-O1: 先建语法树，再生成代码；-O0: 边解析边生成
+//With ast_mode set the parser builds a tree per function instead of
+//writing assembly, and the tree code generator walks it afterwards.
+bool ast_mode = false;
+
+//Expressions
+int NODE_NUM = 1;
+int NODE_STR = 2;
+int NODE_LOCAL = 3;
+int NODE_GLOBAL = 4;
+int NODE_CALL = 5;
+int NODE_INDEX = 6;
+int NODE_NOT = 7;
+int NODE_NEG = 8;
+int NODE_POST_INC = 9;
+int NODE_POST_DEC = 10;
+int NODE_BINARY = 11;
+int NODE_AND = 12;
+int NODE_OR = 13;
+int NODE_COND = 14;
+int NODE_ASSIGN = 15;
+///局部数组的地址，val是偏移
+int NODE_ARRAY = 24;
+///放不进32位的整数，val是wide_text中的下标，原样输出
+int NODE_WIDE = 25;
+
+//Statements
+int NODE_EXPR = 16;
+int NODE_RETURN = 17;
+int NODE_BLOCK = 18;
+int NODE_IF = 19;
+int NODE_WHILE = 20;
+int NODE_DO = 21;
+int NODE_FOR = 22;
+int NODE_INIT = 23;
+
+///节点用平行数组保存，0号节点表示"无"
+//The nodes live in parallel arrays, an arena that is reset for every
+//function. Node 0 means "none".
+// - a, b, c, d: operands (child nodes), depending on the kind
+// - val: the literal, local offset, symbol, label or operator
+// - next: the following statement in a block, or argument in a call
+int* node_kind;
+int* node_a;
+int* node_b;
+int* node_c;
+int* node_d;
+int* node_val;
+int* node_typ;
+int* node_next;
+int node_no = 1;
+int node_cap;
+
+void node_init (int max) {
+    node_no = 1;
+    label_no = 0;
+    node_cap = max;
+    node_kind = renew(node_kind, max, WORD_SIZE);
+    node_a = renew(node_a, max, WORD_SIZE);
+    node_b = renew(node_b, max, WORD_SIZE);
+    node_c = renew(node_c, max, WORD_SIZE);
+    node_d = renew(node_d, max, WORD_SIZE);
+    node_val = renew(node_val, max, WORD_SIZE);
+    node_typ = renew(node_typ, max, WORD_SIZE);
+    node_next = renew(node_next, max, WORD_SIZE);
+}
+
+void regalloc_grow_nodes (int len, int cap);
+
+void node_grow () {
+    int cap = node_cap*2;
+
+    node_kind = grow(node_kind, node_no, cap, WORD_SIZE);
+    node_a = grow(node_a, node_no, cap, WORD_SIZE);
+    node_b = grow(node_b, node_no, cap, WORD_SIZE);
+    node_c = grow(node_c, node_no, cap, WORD_SIZE);
+    node_d = grow(node_d, node_no, cap, WORD_SIZE);
+    node_val = grow(node_val, node_no, cap, WORD_SIZE);
+    node_typ = grow(node_typ, node_no, cap, WORD_SIZE);
+    node_next = grow(node_next, node_no, cap, WORD_SIZE);
+
+    regalloc_grow_nodes(node_no, cap);
+    node_cap = cap;
+}
+
+int new_node (int kind, int a, int b, int val) {
+    if (node_no == node_cap)
+        node_grow();
+
+    int node = node_no++;
+    node_kind[node] = kind;
+    node_a[node] = a;
+    node_b[node] = b;
+    node_c[node] = 0;
+    node_d[node] = 0;
+    node_val[node] = val;
+    node_typ[node] = typ;
+    node_next[node] = 0;
+    return node;
+}
+
+///宽整数的字面量。gcc编译的mini-c的int只有32位，存不下它们的值
+char** wide_text;
+int wide_no = 0;
+int wide_cap = 0;
+
+int new_wide (char* text) {
+    if (wide_no == wide_cap)
+    {
+        wide_cap = wide_cap*2 + 16;
+        wide_text = grow(wide_text, wide_no, wide_cap, PTR_SIZE);
+    }
+
+    wide_text[wide_no] = strdup(text);
+    return new_node(NODE_WIDE, 0, 0, wide_no++);
+}
+
+//==== Constant folding ====
+
+///常量折叠：两边都是常量的运算直接算出结果
+//Folding is done with the compiler's own int, so only operands whose
+//result is sure to fit in 32 bits are folded.
+
+int bit_length (int v) {
+    int n = 0;
+    int p = 1;
+
+    if (v < 0)
+        v = -v;
+
+    if (v >= 1073741824)
+        return 31;
+
+    while (v >= p) {
+        p = p*2;
+        n++;
+    }
+
+    return n;
+}
+
+///常量相对于x的偏移：x+c为c，x-c为-c，不是这种形式时为0
+int offset_of (int node) {
+    int op = node_val[node];
+    int right = node_b[node];
+
+    if (node_kind[node] != NODE_BINARY || node_kind[right] != NODE_NUM || bit_length(node_val[right]) > 28)
+        return 0;
+
+    return op == TOKEN_PLUS ? node_val[right] : (op == TOKEN_MINUS ? -node_val[right] : 0);
+}
+
+///节点是常量时，原地改写成NODE_NUM
+int fold (int node) {
+    int kind = node_kind[node];
+    int op = node_val[node];
+    int a = node_val[node_a[node]];
+    int b = node_val[node_b[node]];
+    int value = 0;
+    int inner = node_a[node];
+
+    //(x + c1) + c2 => x + (c1 + c2)
+    if (offset_of(node) != 0 && offset_of(inner) != 0)
+    {
+        value = offset_of(inner) + offset_of(node);
+        node_a[node] = node_a[inner];
+        node_c[node] = node_c[inner];
+        node_val[node] = TOKEN_PLUS;
+        node_val[node_b[node]] = value;
+        return node;
+    }
+
+    if ((kind == NODE_NOT || kind == NODE_NEG) && node_kind[node_a[node]] == NODE_NUM)
+        value = kind == NODE_NOT ? !a : -a;
+
+    else if (kind != NODE_BINARY || node_kind[node_a[node]] != NODE_NUM || node_kind[node_b[node]] != NODE_NUM)
+        return node;
+
+    else if (op != TOKEN_PLUS && op != TOKEN_MINUS && op != TOKEN_STAR && op != TOKEN_AMP)
+    {
+        //Comparisons only look at the low byte of a char
+        if (node_c[node] == TYPE_CHAR)
+            a = a & 255;
+
+        if (node_d[node] == TYPE_CHAR)
+            b = b & 255;
+
+        if (op == TOKEN_EQ)
+            value = a == b;
+        else if (op == TOKEN_NE)
+            value = a != b;
+        else if (op == TOKEN_LESS)
+            value = a < b;
+        else if (op == TOKEN_GE)
+            value = a >= b;
+        else
+            value = a > b;
+    }
+    else if (op == TOKEN_AMP)
+        value = a & b;
+
+    else if (op == TOKEN_STAR && bit_length(a) + bit_length(b) < 31)
+        value = a*b;
+
+    else if (op == TOKEN_PLUS && bit_length(a) < 30 && bit_length(b) < 30)
+        value = a + b;
+
+    else if (op == TOKEN_MINUS && bit_length(a) < 30 && bit_length(b) < 30)
+        value = a - b;
+
+    else
+        return node;
+
+    node_kind[node] = NODE_NUM;
+    node_val[node] = value;
+    node_a[node] = 0;
+    node_b[node] = 0;
+    return node;
+}
+
+///常量传播：只被赋值一次、且赋的是常量的局部变量，直接用这个常量
+//The first pass counts the writes to each local. The second goes in
+//source order, folding as it goes: once the only write to a local is
+//seen to store a number, the reads after it become that number, so a
+//chain of constants resolves in one pass. A read before the write, as in
+//a loop, stays a read, and then the store stays too.
+//Per symbol, valid while the stamp matches prop_no
+int* sym_prop;
+int* sym_writes;
+int* sym_value;
+int* sym_const_home;
+int* sym_known;
+int* sym_read;
+int prop_no = 0;
+
+void fold_init () {
+    prop_no = 0;
+    sym_prop = renew(sym_prop, sym_cap, WORD_SIZE);
+    sym_writes = renew(sym_writes, sym_cap, WORD_SIZE);
+    sym_value = renew(sym_value, sym_cap, WORD_SIZE);
+    sym_const_home = renew(sym_const_home, sym_cap, WORD_SIZE);
+    sym_known = renew(sym_known, sym_cap, WORD_SIZE);
+    sym_read = renew(sym_read, sym_cap, WORD_SIZE);
+}
+
+void fold_grow (int len, int cap) {
+    sym_prop = grow(sym_prop, len, cap, WORD_SIZE);
+    sym_writes = grow(sym_writes, len, cap, WORD_SIZE);
+    sym_value = grow(sym_value, len, cap, WORD_SIZE);
+    sym_const_home = grow(sym_const_home, len, cap, WORD_SIZE);
+    sym_known = grow(sym_known, len, cap, WORD_SIZE);
+    sym_read = grow(sym_read, len, cap, WORD_SIZE);
+}
+
+///第一遍记录对局部变量的一次写，plain为false时（字节写、自增）不可能是常量
+void note_write (int sym, bool plain, int offset) {
+    if (sym_prop[sym] != prop_no) {
+        sym_prop[sym] = prop_no;
+        sym_writes[sym] = 0;
+        sym_const_home[sym] = offset;
+    }
+
+    sym_writes[sym]++;
+
+    //A parameter already holds the argument, so a write to it is never the only one
+    if (!plain || offset >= 0 || is_param_home(offset) || sym_const_home[sym] != offset)
+        sym_writes[sym] = 2;
+}
+
+///第二遍到了唯一的那次写：写的是常量时记下来，返回这次写是否可以删掉
+bool note_value (int sym, int value, int offset) {
+    if (sym_writes[sym] != 1 || sym_const_home[sym] != offset || node_kind[value] != NODE_NUM)
+        return false;
+
+    sym_known[sym] = prop_no;
+    sym_value[sym] = node_val[value];
+    return sym_read[sym] != prop_no;
+}
+
+bool is_const (int sym, int offset) {
+    return sym_known[sym] == prop_no && sym_const_home[sym] == offset;
+}
+
+///第一遍(replace为false)数每个局部变量被写了几次，第二遍把常量代入并折叠
+void propagate (int node, bool replace) {
+    int kind = node_kind[node];
+    int a = node_a[node];
+    int b = node_b[node];
+    int sub = 0;
+
+    if (node == 0)
+        return;
+
+    if (kind == NODE_BLOCK)
+    {
+        for (sub = a; sub; sub = node_next[sub])
+            propagate(sub, replace);
+    }
+    else if (kind == NODE_CALL)
+    {
+        propagate(a, replace);
+
+        for (sub = b; sub; sub = node_next[sub])
+            propagate(sub, replace);
+    }
+    else if (kind == NODE_LOCAL)
+    {
+        if (replace && is_const(b, node_val[node]))
+        {
+            //b was the symbol; a number has no children
+            node_kind[node] = NODE_NUM;
+            node_val[node] = sym_value[b];
+            node_b[node] = 0;
+        }
+        else if (replace)
+            sym_read[b] = prop_no;
+    }
+    else if (kind == NODE_INIT)
+    {
+        propagate(a, replace);
+
+        if (!replace)
+            note_write(b, true, node_val[node]);
+
+        else if (note_value(b, a, node_val[node]))
+        {
+            //The store is dead, leave an empty block
+            node_kind[node] = NODE_BLOCK;
+            node_a[node] = 0;
+        }
+    }
+    else if ((kind == NODE_ASSIGN || kind == NODE_POST_INC || kind == NODE_POST_DEC) && node_kind[a] == NODE_LOCAL)
+    {
+        propagate(b, replace);
+
+        //A byte store keeps the upper bytes, so it is never a constant
+        if (!replace)
+            note_write(node_b[a], kind == NODE_ASSIGN && !node_val[node], node_val[a]);
+
+        else if (kind == NODE_ASSIGN && note_value(node_b[a], b, node_val[a]))
+        {
+            node_kind[node] = NODE_NUM;
+            node_val[node] = sym_value[node_b[a]];
+            node_a[node] = 0;
+            node_b[node] = 0;
+        }
+    }
+    else
+    {
+        propagate(a, replace);
+        propagate(b, replace);
+
+        if (kind == NODE_COND || kind == NODE_IF || kind == NODE_FOR)
+            propagate(node_c[node], replace);
+
+        if (kind == NODE_FOR)
+            propagate(node_d[node], replace);
+
+        if (replace)
+            fold(node);
+    }
+}
+
+void propagate_consts (int body) {
+    prop_no++;
+    propagate(body, false);
+    propagate(body, true);
+}
+
+//==== Register allocation ====
+
+///临时值用易失寄存器，局部变量用被调用者保存的寄存器
+//Temporaries live in scratch registers while an expression is evaluated,
+//never across a call. Locals and parameters get callee-saved registers,
+//which survive calls and are saved in the prologue. A leaf function can
+//also keep them in the argument registers, which need no saving; the
+//temporaries then make do with the scratch registers left over.
+char** temp_reg;
+int TEMP_REGS = 5;
+int temp_no = 0;
+
+///可用的临时寄存器数。参数直接求值到rcx、rdx、r8、r9时，只能用r10
+//r11 is not among them: the shared code uses it as scratch.
+int temp_max = 5;
+
+char** var_reg;
+char** var_reg32;
+int VAR_REGS = 10;
+
+///前面的是易失寄存器，和参数寄存器顺序相同，只在叶子函数中使用
+int VOLATILE_REGS = 4;
+int first_reg = 4;
+
+char** arg_reg;
+
+//Per symbol, only valid while sym_fn matches the current function
+int* sym_fn;
+int* sym_reg;      // 1 + index into var_reg, or 0 for the stack slot
+int* sym_home;     // the stack slot, or 0 if it was declared twice
+int* sym_start;
+int* sym_end;
+int* sym_weight;
+int fn_no = 0;
+
+///当前函数用到的局部变量，按第一次出现的顺序
+int* fn_vars;
+int fn_var_no;
+
+int* loop_start;
+int* loop_end;
+int loop_no;
+int scan_pos;
+
+int* reg_owner;
+int* reg_used;
+
+///当前函数要保存的寄存器
+int* saved_reg;
+int saved_no = 0;
+
+//Bottom-up per node: scratch registers needed besides rax (Sethi-Ullman),
+//whether the subtree makes a call, and whether it writes anything
+int* node_need;
+int* node_calls;
+int* node_writes;
+
+char* opnd;
+
+void regalloc_init () {
+    int i = 0;
+
+    temp_no = 0;
+    fn_no = 0;
+    saved_no = 0;
+
+    temp_reg = renew(temp_reg, TEMP_REGS, PTR_SIZE);
+    temp_reg[0] = "r10";
+    temp_reg[1] = "r8";
+    temp_reg[2] = "r9";
+    temp_reg[3] = "rcx";
+    temp_reg[4] = "rdx";
+
+    var_reg = renew(var_reg, VAR_REGS, PTR_SIZE);
+    var_reg32 = renew(var_reg32, VAR_REGS, PTR_SIZE);
+
+    if (abi == ABI_SYSV)
+    {
+        //rsi and rdi carry arguments here instead of being callee-saved
+        ARG_REGS = 6;
+        var_reg[0] = "rdi";
+        var_reg[1] = "rsi";
+        var_reg[2] = "rdx";
+        var_reg[3] = "rcx";
+        var_reg[4] = "r8";
+        var_reg[5] = "r9";
+        var_reg32[0] = "edi";
+        var_reg32[1] = "esi";
+        var_reg32[2] = "edx";
+        var_reg32[3] = "ecx";
+        var_reg32[4] = "r8d";
+        var_reg32[5] = "r9d";
+    }
+    else
+    {
+        ARG_REGS = 4;
+        var_reg[0] = "rcx";
+        var_reg[1] = "rdx";
+        var_reg[2] = "r8";
+        var_reg[3] = "r9";
+        var_reg[4] = "rsi";
+        var_reg[5] = "rdi";
+        var_reg32[0] = "ecx";
+        var_reg32[1] = "edx";
+        var_reg32[2] = "r8d";
+        var_reg32[3] = "r9d";
+        var_reg32[4] = "esi";
+        var_reg32[5] = "edi";
+    }
+
+    var_reg[6] = "r12";
+    var_reg[7] = "r13";
+    var_reg[8] = "r14";
+    var_reg[9] = "r15";
+    var_reg32[6] = "r12d";
+    var_reg32[7] = "r13d";
+    var_reg32[8] = "r14d";
+    var_reg32[9] = "r15d";
+
+    ///参数寄存器就是前面的易失寄存器
+    VOLATILE_REGS = ARG_REGS;
+    arg_reg = renew(arg_reg, ARG_REGS, PTR_SIZE);
+
+    for (i = 0; i < ARG_REGS; i++)
+        arg_reg[i] = var_reg[i];
+
+    sym_fn = renew(sym_fn, sym_cap, WORD_SIZE);
+    sym_reg = renew(sym_reg, sym_cap, WORD_SIZE);
+    sym_home = renew(sym_home, sym_cap, WORD_SIZE);
+    sym_start = renew(sym_start, sym_cap, WORD_SIZE);
+    sym_end = renew(sym_end, sym_cap, WORD_SIZE);
+    sym_weight = renew(sym_weight, sym_cap, WORD_SIZE);
+    fn_vars = renew(fn_vars, sym_cap, WORD_SIZE);
+
+    loop_start = renew(loop_start, node_cap, WORD_SIZE);
+    loop_end = renew(loop_end, node_cap, WORD_SIZE);
+    node_need = renew(node_need, node_cap, WORD_SIZE);
+    node_calls = renew(node_calls, node_cap, WORD_SIZE);
+    node_writes = renew(node_writes, node_cap, WORD_SIZE);
+
+    reg_owner = renew(reg_owner, VAR_REGS, WORD_SIZE);
+    reg_used = renew(reg_used, VAR_REGS, WORD_SIZE);
+    saved_reg = renew(saved_reg, VAR_REGS, WORD_SIZE);
+    free(opnd);
+    opnd = malloc(256);
+}
+
+void regalloc_grow (int len, int cap) {
+    sym_fn = grow(sym_fn, len, cap, WORD_SIZE);
+    sym_reg = grow(sym_reg, len, cap, WORD_SIZE);
+    sym_home = grow(sym_home, len, cap, WORD_SIZE);
+    sym_start = grow(sym_start, len, cap, WORD_SIZE);
+    sym_end = grow(sym_end, len, cap, WORD_SIZE);
+    sym_weight = grow(sym_weight, len, cap, WORD_SIZE);
+    fn_vars = grow(fn_vars, len, cap, WORD_SIZE);
+}
+
+///按结点编号的数组，跟着语法树变大
+void regalloc_grow_nodes (int len, int cap) {
+    loop_start = grow(loop_start, len, cap, WORD_SIZE);
+    loop_end = grow(loop_end, len, cap, WORD_SIZE);
+    node_need = grow(node_need, len, cap, WORD_SIZE);
+    node_calls = grow(node_calls, len, cap, WORD_SIZE);
+    node_writes = grow(node_writes, len, cap, WORD_SIZE);
+}
+
+int max_int (int a, int b) {
+    return a > b ? a : b;
+}
+
+///叶子节点可以直接作为指令的操作数
+//Leaves that can be used directly as an instruction operand
+bool is_operand (int node) {
+    int kind = node_kind[node];
+    return kind == NODE_NUM || kind == NODE_LOCAL || (kind == NODE_GLOBAL && !sym_is_fn[node_val[node]]);
+}
+
+bool is_pure (int node) {
+    return !node_writes[node];
+}
+
+///记录局部变量的一次使用，循环里的使用权重更高
+//Extend the live interval of a local over this use
+void touch (int sym, int offset, int depth) {
+    int weight = 1;
+
+    if (sym_fn[sym] != fn_no)
+    {
+        sym_fn[sym] = fn_no;
+        sym_reg[sym] = 0;
+        sym_home[sym] = offset;
+        sym_start[sym] = scan_pos;
+
+        //Parameters arrive live at the entry
+        if (is_param_home(offset))
+            sym_start[sym] = -1;
+
+        sym_weight[sym] = 0;
+        fn_vars[fn_var_no++] = sym;
+    }
+
+    //Declared again in the same function: keep it on the stack
+    if (sym_home[sym] != offset)
+        sym_home[sym] = 0;
+
+    while (depth > 0) {
+        if (weight < 4096)
+            weight = weight*8;
+
+        depth--;
+    }
+
+    sym_weight[sym] = sym_weight[sym] + weight;
+    sym_end[sym] = scan_pos++;
+}
+
+///按求值顺序遍历语法树：给变量的使用编号，记录循环，并自底向上计算
+///每个节点需要的寄存器数
+void scan (int node, int depth) {
+    int kind = node_kind[node];
+    int a = node_a[node];
+    int b = node_b[node];
+    int c = 0;
+    int sub = 0;
+    int start = 0;
+    int left = 0;
+    int right = 0;
+
+    if (node == 0)
+        return;
+
+    node_need[node] = 0;
+    node_calls[node] = kind == NODE_CALL;
+    node_writes[node] = kind == NODE_CALL || kind == NODE_ASSIGN || kind == NODE_POST_INC || kind == NODE_POST_DEC;
+
+    if (kind == NODE_LOCAL)
+        touch(b, node_val[node], depth);
+
+    else if (kind == NODE_BLOCK)
+    {
+        for (sub = a; sub; sub = node_next[sub])
+            scan(sub, depth);
+    }
+    else if (kind == NODE_CALL)
+    {
+        fn_calls = true;
+        scan(a, depth);
+
+        for (sub = b; sub; sub = node_next[sub])
+            scan(sub, depth);
+    }
+    else if (kind == NODE_INIT)
+    {
+        scan(a, depth);
+        touch(b, node_val[node], depth);
+    }
+    else if (kind == NODE_WHILE || kind == NODE_DO || kind == NODE_FOR)
+    {
+        //The init statement of a for runs once, before the loop
+        if (kind == NODE_FOR)
+            scan(a, depth);
+
+        start = scan_pos;
+
+        if (kind != NODE_FOR)
+            scan(a, depth+1);
+
+        scan(b, depth+1);
+        scan(node_c[node], depth+1);
+        scan(node_d[node], depth+1);
+
+        loop_start[loop_no] = start;
+        loop_end[loop_no] = scan_pos;
+        loop_no++;
+    }
+    else
+    {
+        if (kind == NODE_COND || kind == NODE_IF)
+            c = node_c[node];
+
+        scan(a, depth);
+        scan(b, depth);
+        scan(c, depth);
+
+        node_calls[node] = node_calls[a] || node_calls[b] || node_calls[c];
+        node_writes[node] = node_writes[node] || node_writes[a] || node_writes[b] || node_writes[c];
+
+        left = node_need[a];
+        right = node_need[b];
+
+        if ((kind == NODE_BINARY || kind == NODE_INDEX) && !is_operand(b))
+        {
+            if (node_calls[b])
+                node_need[node] = max_int(left, right);
+
+            else if (is_pure(a) && is_pure(b))
+                //Either side can go first
+                node_need[node] = left == right ? left + 1 : max_int(left, right);
+
+            else
+                node_need[node] = max_int(left, right + 1);
+        }
+        else
+            node_need[node] = max_int(max_int(left, right), node_need[c]);
+    }
+}
+
+///线性扫描分配寄存器
+//Linear scan over the live intervals. When the registers run out, the
+//interval with the lowest use count (weighted by loop depth) is spilled.
+void alloc_regs () {
+    int i = 0;
+    int j = 0;
+    int sym = 0;
+    int other = 0;
+    int victim = 0;
+
+    //A local used in a loop is live for the whole loop
+    for (i = 0; i < loop_no; i++)
+    {
+        for (j = 0; j < fn_var_no; j++)
+        {
+            sym = fn_vars[j];
+
+            if (sym_start[sym] < loop_end[i] && sym_end[sym] >= loop_start[i])
+            {
+                if (loop_start[i] < sym_start[sym])
+                    sym_start[sym] = loop_start[i];
+
+                if (sym_end[sym] < loop_end[i] - 1)
+                    sym_end[sym] = loop_end[i] - 1;
+            }
+        }
+    }
+
+    //Sort by start
+    for (i = 1; i < fn_var_no; i++)
+    {
+        sym = fn_vars[i];
+        j = i;
+
+        while (j > 0 && sym_start[fn_vars[j-1]] > sym_start[sym]) {
+            fn_vars[j] = fn_vars[j-1];
+            j--;
+        }
+
+        fn_vars[j] = sym;
+    }
+
+    for (j = 0; j < VAR_REGS; j++)
+    {
+        reg_owner[j] = -1;
+        reg_used[j] = false;
+    }
+
+    saved_no = 0;
+
+    //Only a leaf function can keep locals in the argument registers
+    first_reg = fn_calls ? VOLATILE_REGS : 0;
+
+    for (i = 0; i < fn_var_no; i++)
+    {
+        sym = fn_vars[i];
+        victim = -1;
+
+        //Expire the intervals that have ended, then prefer a free register,
+        //else the one whose owner is cheapest to spill
+        for (j = first_reg; j < VAR_REGS; j++)
+        {
+            other = reg_owner[j];
+
+            if (other >= 0 && sym_end[other] < sym_start[sym])
+            {
+                reg_owner[j] = -1;
+                other = -1;
+            }
+
+            if (victim < 0 || (reg_owner[victim] >= 0 && (other < 0 || sym_weight[other] < sym_weight[reg_owner[victim]])))
+                victim = j;
+        }
+
+        //A parameter stays in the register it arrived in, if it can
+        for (j = first_reg; j < VOLATILE_REGS; j++)
+        {
+            if (sym_home[sym] == param_offset(j) && reg_owner[j] < 0)
+                victim = j;
+        }
+
+        other = reg_owner[victim];
+
+        if (sym_home[sym] != 0 && (other < 0 || sym_weight[other] < sym_weight[sym]))
+        {
+            if (other >= 0)
+                sym_reg[other] = 0;
+
+            reg_owner[victim] = sym;
+            sym_reg[sym] = victim + 1;
+            reg_used[victim] = true;
+        }
+    }
+
+    //Every callee-saved register handed out is saved and restored
+    for (j = VOLATILE_REGS; j < VAR_REGS; j++)
+    {
+        if (reg_used[j])
+            saved_reg[saved_no++] = j;
+    }
+
+    //Argument registers holding locals are no longer free as temporaries
+    temp_max = TEMP_REGS;
+
+    for (j = 0; j < VOLATILE_REGS; j++)
+    {
+        for (i = 0; i < TEMP_REGS; i++)
+        {
+            if (reg_used[j] && i < temp_max && strcmp(temp_reg[i], var_reg[j]) == 0)
+                temp_max = i;
+        }
+    }
+}
+
+///第k个保存的寄存器在栈中的偏移量，在局部变量下面
+int save_offset (int k) {
+    return -WORD_SIZE*(local_slots() + k + 1);
+}
+
+///第i个参数分到的寄存器，没有则为0
+int param_reg (int i) {
+    int j = 0;
+    int reg = 0;
+
+    for (j = 0; j < fn_var_no; j++)
+    {
+        if (sym_home[fn_vars[j]] == param_offset(i))
+            reg = sym_reg[fn_vars[j]];
+    }
+
+    return reg;
+}
+
+//==== Instrumentation ====
+
+///-finstrument：每个函数进出时计数，累加rdtsc的周期数，main结束时把排好序的表写到mini-c.prof
+//Every function gets three words in .data at mc_prof_NAME: its calls,
+//its cycles and how deeply it is running. When the outermost call comes
+//in, the time stamp counter is subtracted from the cycles, and it is
+//added back when that call returns. So the cycles include the callees,
+//recursion is not counted twice, and no slot is needed in the frame.
+//Only rax, rdx and r11 are touched; rdx may carry an argument and is put
+//back.
+bool instrument = false;
+
+char** prof_fns;
+int prof_no = 0;
+int prof_cap = 0;
+
+///写出表的函数用mini-c写成，和程序一起编译，它自己不计数
+//The table starts with the number of functions. Each entry is the three
+//words above, the size of the name, then the name padded to a word.
+char* profile_src;
+
+void profile_init () {
+    prof_no = 0;
+    prof_cap = 64;
+    prof_fns = renew(prof_fns, prof_cap, PTR_SIZE);
+
+    profile_src =
+        "int mc_profile_dump (int* prof) {"
+        "    int n = prof[0];"
+        "    int* fns = calloc(n + 1, 8);"
+        "    int* p = prof + 8;"
+        "    int* a = 0;"
+        "    int* b = 0;"
+        "    int f = 0;"
+        "    int i = 0;"
+        "    int j = 0;"
+        "    int best = 0;"
+        "    for (i = 0; i < n; i++) {"
+        "        fns[i] = p;"
+        "        p = p + 32 + p[3];"
+        "    }"
+        "    for (i = 0; i < n; i++) {"
+        "        best = i;"
+        "        for (j = i + 1; j < n; j++) {"
+        "            a = fns[j];"
+        "            b = fns[best];"
+        "            if (a[1] > b[1])"
+        "                best = j;"
+        "        }"
+        "        a = fns[i];"
+        "        fns[i] = fns[best];"
+        "        fns[best] = a;"
+        "    }"
+        "    f = fopen(\"mini-c.prof\", \"w\");"
+        "    if (f) {"
+        "        fprintf(f, \"%12s %16s  %s\\n\", \"calls\", \"cycles\", \"function\");"
+        "        for (i = 0; i < n; i++) {"
+        "            a = fns[i];"
+        "            fprintf(f, \"%12lld %16lld  %s\\n\", a[0], a[1], a + 32);"
+        "        }"
+        "        fclose(f);"
+        "    }"
+        "    free(fns);"
+        "    return 0;"
+        "}";
+
+    if (instrument)
+    {
+        sym_intern("mc_profile");
+        sym_intern("mc_profile_dump");
+    }
+}
+
+void profile_add (char* ident) {
+    char* name = 0;
+
+    if (prof_no == prof_cap)
+    {
+        prof_fns = grow(prof_fns, prof_no, prof_cap*2, PTR_SIZE);
+        prof_cap = prof_cap*2;
+    }
+
+    prof_fns[prof_no++] = ident;
+
+    //The assembler looks names up as they are used, before .data is written
+    name = malloc(strlen(ident) + 9);
+    strcpy(name, "mc_prof_");
+    strcpy(name+8, ident);
+    sym_intern(name);
+    free(name);
+}
+
+///rdx:rax = 时间戳
+void emit_rdtsc () {
+    emit_ins("rdtsc", 0, 0);
+    emit_imm("shl", "rdx", 32);
+    emit_ins("or", "rax", "rdx");
+}
+
+///mc_prof_NAME加上第n个字的内存操作数
+char* prof_slot (char* ident, int n) {
+    char* p = put_text(ins_space(strlen(ident) + 32), "qword [mc_prof_");
+
+    p = put_text(p, ident);
+
+    if (n)
+        p = put_disp(p, n*WORD_SIZE);
+
+    return ins_keep(put_text(p, "]"));
+}
+
+void emit_prof_ins (char* op, char* ident, int n, char* value) {
+    emit_ins(op, prof_slot(ident, n), value);
+}
+
+///只有最外层的调用读时钟，递归的调用只计数
+void emit_profile_enter (char* ident) {
+    int skip = new_label();
+
+    emit_prof_ins("add", ident, 0, "1");
+    emit_prof_ins("add", ident, 2, "1");
+    emit_prof_ins("cmp", ident, 2, "1");
+    emit_jump("jne", skip);
+    emit_ins("mov", "r11", "rdx");
+    emit_rdtsc();
+    emit_prof_ins("sub", ident, 1, "rax");
+    emit_ins("mov", "rdx", "r11");
+    emit_label(skip);
+}
+
+///返回值在rax中。main在这之后写出表
+void emit_profile_exit (char* ident) {
+    int skip = new_label();
+
+    emit_prof_ins("sub", ident, 2, "1");
+    emit_jump("jne", skip);
+    emit_ins("mov", "r11", "rax");
+    emit_rdtsc();
+    emit_prof_ins("add", ident, 1, "rax");
+    emit_ins("mov", "rax", "r11");
+    emit_label(skip);
+
+    if (strcmp(ident, "main") == 0)
+    {
+        emit_ins("push", "rax", 0);
+        emit_imm("sub", "rsp", 4*WORD_SIZE);
+        emit_ins("lea", arg_reg[0], "[mc_profile]");
+        emit_ins("call", "mc_profile_dump", 0);
+        emit_imm("add", "rsp", 4*WORD_SIZE);
+        emit_ins("pop", "rax", 0);
+    }
+}
+
+
+///.data中的表，见profile_src
+void profile_table () {
+    int i = 0;
+    int size = 0;
+    int length = 0;
+
+    emit("mc_profile dq ");
+    emit_int(prof_no);
+    emit_char('\n');
+
+    for (i = 0; i < prof_no; i++)
+    {
+        length = strlen(prof_fns[i]);
+        size = WORD_SIZE;
+
+        while (size < length+1)
+            size = size + WORD_SIZE;
+
+        emit("mc_prof_");
+        emit(prof_fns[i]);
+        emit(" dq 0,0,0,");
+        emit_int(size);
+        emit("\ndb '");
+        emit(prof_fns[i]);
+        emit("'");
+
+        while (length < size) {
+            emit(",0");
+            length++;
+        }
+
+        emit_char('\n');
+    }
+}
+
+//==== Shared code emission ====
+
+///两种模式共用，保证生成的代码一致
+//Used by both the streaming parser and the tree code generator
+
+///后置++/--：地址在rax中
+void emit_post_step (bool inc) {
+    emit_ins("mov", "r11", "rax");
+    emit_ins("mov", "rax", "[r11]");
+    emit_ins(inc ? "add" : "sub", "qword [r11]", "1");
+    //%s dword ptr [r11], 1
+}
+
+///调用指令：内部函数直接调用，外部函数通过导入表调用
+//callee is -1 when the function address was saved at [rsp+slot]. On
+//System V the linker resolves library functions, so they are called by
+//name like internal ones.
+void emit_call_insn (int callee, int slot) {
+    if (callee < 0)
+        emit_ins("call", ins_join("qword ", ins_mem("rsp", slot)), 0);
+
+    else if (sym_is_extern[callee] && abi == ABI_MS)
+        emit_ins("call", ins_join(ins_join("qword [", sym_name[callee]), "]"), 0);
+
+    else
+        emit_ins("call", sym_name[callee], 0);
+
+    ///库函数返回的int只在eax中，高32位是未定义的
+    if (callee >= 0 && sym_is_extern[callee] && sym_global_type[callee] == TYPE_INT)
+        emit_ins("movsxd", "rax", "eax");
+}
+
+///System V：库函数要求调用时rsp按16字节对齐
+//A variadic library function also reads al as the number of vector
+//registers used, so it is cleared. Internal functions keep no alignment.
+bool needs_align (int callee) {
+    return abi == ABI_SYSV && (callee < 0 || sym_is_extern[callee]);
+}
+
+//The old rsp is pushed just under the 16 byte boundary, then pad bytes
+//so that rsp is aligned again after the slots below it are filled
+void emit_align (int slots) {
+    emit_ins("mov", "rax", "rsp");
+    emit_imm("and", "rsp", -16);
+    emit_ins("push", "rax", 0);
+
+    if ((slots & 1) == 0)
+        emit_imm("sub", "rsp", 8);
+}
+
+void emit_unalign (int slots) {
+    emit_load("mov", "rsp", "rsp", (slots + 1 - (slots & 1))*WORD_SIZE);
+}
+
+///函数调用：参数已经从左到右压栈，函数指针（如有）在参数上面
+///x64中，每个函数调用，栈中必须至少有4个位置，避免只有1个参数时，栈中其它数值被调用函数覆盖
+//Argument i was pushed to [rsp+8*(arg_no-1-i)]. The first four go to
+//rcx, rdx, r8 and r9; from the fifth on they must be at [rsp+8*i], so
+//the pushed slots are reversed in place when there are more than four.
+void emit_call_ms (int callee, int arg_no) {
+    int i = 0;
+    int j = arg_no - 1;
+    int slots = arg_no;
+
+    if (arg_no > 4)
+    {
+        while (i < j) {
+            emit_load("mov", "rax", "rsp", i*WORD_SIZE);
+            emit_load("mov", "r11", "rsp", j*WORD_SIZE);
+            emit_save("rsp", i*WORD_SIZE, "r11");
+            emit_save("rsp", j*WORD_SIZE, "rax");
+            i++;
+            j--;
+        }
+    }
+
+    for (i = 0; i < arg_no && i < 4; i++)
+        emit_load("mov", arg_reg[i], "rsp", (arg_no > 4 ? i : arg_no-1-i)*WORD_SIZE);
+
+    ///参数已经在寄存器中，它们的位置可以作为预留的位置
+    if (arg_no < 4)
+    {
+        emit_imm("sub", "rsp", (4-arg_no)*WORD_SIZE);
+        slots = 4;
+    }
+
+    emit_call_insn(callee, slots*WORD_SIZE);
+    emit_imm("add", "rsp", (callee < 0 ? slots+1 : slots)*WORD_SIZE);
+}
+
+//System V: the first six go to rdi, rsi, rdx, rcx, r8 and r9, and there
+//is no shadow space. The stack arguments must be at [rsp+8*(i-6)], so they
+//are pushed again below the evaluated ones, last first, with rax holding
+//the old rsp. The pushed values are dropped after the call.
+void emit_call_sysv (int callee, int arg_no) {
+    int i = 0;
+    int stack_no = arg_no > ARG_REGS ? arg_no - ARG_REGS : 0;
+    bool copy = needs_align(callee) || stack_no > 0;
+    char* base = copy ? "rax" : "rsp";
+
+    if (needs_align(callee))
+        emit_align(stack_no);
+
+    else if (copy)
+        emit_ins("mov", "rax", "rsp");
+
+    for (i = arg_no - 1; i >= ARG_REGS; i--)
+        emit_ins("push", ins_join("qword ", ins_mem("rax", (arg_no-1-i)*WORD_SIZE)), 0);
+
+    for (i = 0; i < arg_no && i < ARG_REGS; i++)
+        emit_load("mov", arg_reg[i], base, (arg_no-1-i)*WORD_SIZE);
+
+    if (callee < 0)
+        emit_load("mov", "r11", "rax", arg_no*WORD_SIZE);
+
+    if (needs_align(callee))
+        emit_ins("xor", "eax", "eax");
+
+    if (callee < 0)
+        emit_ins("call", "r11", 0);
+    else
+        emit_call_insn(callee, 0);
+
+    if (needs_align(callee))
+        emit_unalign(stack_no);
+
+    else if (stack_no)
+        emit_imm("add", "rsp", stack_no*WORD_SIZE);
+
+    if (arg_no || callee < 0)
+        emit_imm("add", "rsp", (callee < 0 ? arg_no+1 : arg_no)*WORD_SIZE);
+}
+
+void emit_call (int callee, int arg_no) {
+    if (abi == ABI_SYSV)
+        emit_call_sysv(callee, arg_no);
+    else
+        emit_call_ms(callee, arg_no);
+}
+
+///参数从参数寄存器挪到分到的寄存器，各个mov要当作同时发生
+//The moves between argument registers happen as if all at once: a move
+//waits while its destination is still to be read by another, and a cycle
+//is broken through rax, which carries no argument. The homes are written
+//before anything moves and the stack arguments loaded after.
+void emit_param_moves () {
+    int from[8];
+    int to[8];
+    int move_no = 0;
+    int i = 0;
+    int j = 0;
+    int reg = 0;
+    bool blocked = false;
+
+    for (i = 0; i < param_no && i < ARG_REGS; i++)
+    {
+        reg = param_reg(i);
+
+        if (reg && reg - 1 != i)
+        {
+            from[move_no] = i;
+            to[move_no] = reg - 1;
+            move_no++;
+        }
+    }
+
+    while (move_no > 0) {
+        for (i = 0; i < move_no; i++)
+        {
+            blocked = false;
+
+            for (j = 0; j < move_no; j++)
+            {
+                if (from[j] == to[i])
+                    blocked = true;
+            }
+
+            if (!blocked)
+            {
+                emit_ins("mov", var_reg[to[i]], from[i] < 0 ? "rax" : var_reg[from[i]]);
+                move_no--;
+                from[i] = from[move_no];
+                to[i] = to[move_no];
+                i = move_no;
+            }
+        }
+
+        //Only cycles are left
+        if (blocked)
+        {
+            emit_ins("mov", "rax", var_reg[from[0]]);
+            from[0] = -1;
+        }
+    }
+}
+
+void emit_param_spills () {
+    int i = 0;
+    int reg = 0;
+
+    ///此处是函数体内部
+    /// 应该先将参数放入堆栈，方便当前代码使用
+    for (i = 0; i < param_no && i < ARG_REGS; i++)
+    {
+        if (has_frame && !param_reg(i))
+            emit_save("rbp", param_offset(i), arg_reg[i]);
+    }
+
+    ///分到寄存器的参数直接放入寄存器
+    emit_param_moves();
+
+    ///没有栈帧时，还没有压栈，参数相对rsp比rbp少一个位置
+    for (i = ARG_REGS; i < param_no; i++)
+    {
+        reg = param_reg(i);
+
+        if (reg && has_frame)
+            emit_load("mov", var_reg[reg - 1], "rbp", param_offset(i));
+
+        else if (reg)
+            emit_load("mov", var_reg[reg - 1], "rsp", param_offset(i) - WORD_SIZE);
+    }
+}
+
+///Windows的栈只在碰到保护页时往下长，所以大的栈帧（局部数组）要一页一页地碰
+//Windows commits the stack one guard page at a time, so a frame of a page
+//or more is grown a page at a time, touching each, like _chkstk does.
+//The arguments are still in their registers, r11 is free.
+int PAGE_SIZE = 4096;
+
+void emit_stack_probe (int size) {
+    int loop = new_label();
+    int pages = 0;
+
+    while (size >= PAGE_SIZE) {
+        size = size - PAGE_SIZE;
+        pages++;
+    }
+
+    emit_imm("mov", "r11", pages);
+    emit_label(loop);
+    emit_imm("sub", "rsp", PAGE_SIZE);
+    emit_ins("mov", "qword [rsp]", "0");
+    emit_imm("sub", "r11", 1);
+    emit_jump("jne", loop);
+
+    if (size)
+        emit_imm("sub", "rsp", size);
+}
+
+void emit_prologue (char* ident, int slots) {
+    if (ins_capture)
+        ins_label(ins_copy(ident));
+
+    else
+    {
+        emit(ident);
+        emit(":\n");
+    }
+
+    if (instrument)
+        emit_profile_enter(ident);
+
+    if (has_frame)
+    {
+        emit_ins("push", "rbp", 0);
+        emit_ins("mov", "rbp", "rsp");
+    }
+
+    if (has_frame && slots*WORD_SIZE >= PAGE_SIZE && abi == ABI_MS)
+        emit_stack_probe(slots*WORD_SIZE);
+
+    else if (has_frame && slots)
+        emit_imm("sub", "rsp", slots*WORD_SIZE);
+}
+
+void emit_epilogue (char* ident) {
+    int i = 0;
+
+    ///main从crt返回，退出码是0
+    if(strcmp(ident, "main")==0 && abi == ABI_SYSV)
+        emit_imm("mov", "rax", 0);
+
+    else if(strcmp(ident, "main")==0)
+    {
+        if (instrument)
+            emit_profile_exit(ident);
+
+        emit_imm("mov", "rcx", 0);
+        emit_ins("call", "[ExitProcess]", 0);
+    }
+    //Epilogue
+
+    emit_label(return_to);
+
+    if (instrument)
+        emit_profile_exit(ident);
+
+    for (i = 0; i < saved_no; i++)
+        emit_load("mov", var_reg[saved_reg[i]], "rbp", save_offset(i));
+
+    if (has_frame)
+    {
+        emit_ins("mov", "rsp", "rbp");
+        emit_ins("pop", "rbp", 0);
+    }
+
+    emit_ins("ret", 0, 0);
+}
+
+//==== Peephole optimizer ====
+
+///-fpeephole: 每个函数的指令直接放进指令缓存，改写后再输出
+//With peephole set, the typed emit_ helpers do not write the code of a
+//function as text but add one record per instruction to the buffer
+//below. The rewrite rules then run over it until nothing changes, and
+//only then is it written out as text.
+bool peephole = false;
+
+int OP_DEAD = 0;
+int OP_LABEL = 1;
+int OP_NOTE = 2;
+int OP_MOV = 3;
+int OP_PUSH = 4;
+int OP_POP = 5;
+int OP_CMP = 6;
+int OP_JMP = 7;
+int OP_JCC = 8;
+int OP_SETCC = 9;
+int OP_OTHER = 10;
+
+///当前函数的指令，用平行数组保存
+//The instruction buffer. The assembler behind -c also parses its lines
+//into it, one at a time. Labels and notes keep their whole line in
+//ins_name, and a label also has its bare name in ins_a.
+int* ins_op;
+char** ins_name;
+char** ins_a;
+char** ins_b;
+int ins_no = 0;
+int ins_cap = 0;
+
+///操作数的文本，一个函数用完就收回，只留下第一块
+//Operands are copied here, as the helpers build them in place or get
+//them from buffers that are reused, such as opnd.
+char* ins_pool;
+int ins_pool_used = 0;
+int ins_pool_size = 0;
+char** ins_pool_chunks;
+int ins_pool_no = 0;
+int ins_pool_cap = 0;
+
+//The rule table, with how many instructions each rule removed or rewrote
+int PEEP_PUSH_POP = 0;
+int PEEP_PUSH_MOV_POP = 1;
+int PEEP_STORE_LOAD = 2;
+int PEEP_CMP_JCC_CMP = 3;
+int PEEP_JMP_NEXT = 4;
+int PEEP_ZERO_XOR = 5;
+int PEEP_RULES = 6;
+
+char** peep_name;
+int* peep_removed;
+int* peep_rewrote;
+
+char** reg64_name;
+char** reg32_name;
+int REG_NAMES = 14;
+
+void peep_init () {
+    ins_capture = false;
+    peep_name = renew(peep_name, PEEP_RULES, PTR_SIZE);
+    peep_removed = renew(peep_removed, PEEP_RULES, WORD_SIZE);
+    peep_rewrote = renew(peep_rewrote, PEEP_RULES, WORD_SIZE);
+
+    peep_name[PEEP_PUSH_POP] = "push/pop";
+    peep_name[PEEP_PUSH_MOV_POP] = "push/mov/pop";
+    peep_name[PEEP_STORE_LOAD] = "store/load";
+    peep_name[PEEP_CMP_JCC_CMP] = "cmp/jcc/cmp";
+    peep_name[PEEP_JMP_NEXT] = "jmp next";
+    peep_name[PEEP_ZERO_XOR] = "mov 0 -> xor";
+
+    reg64_name = renew(reg64_name, REG_NAMES, PTR_SIZE);
+    reg32_name = renew(reg32_name, REG_NAMES, PTR_SIZE);
+    reg64_name[0] = "rax";
+    reg64_name[1] = "rbx";
+    reg64_name[2] = "rcx";
+    reg64_name[3] = "rdx";
+    reg64_name[4] = "rsi";
+    reg64_name[5] = "rdi";
+    reg64_name[6] = "r8";
+    reg64_name[7] = "r9";
+    reg64_name[8] = "r10";
+    reg64_name[9] = "r11";
+    reg64_name[10] = "r12";
+    reg64_name[11] = "r13";
+    reg64_name[12] = "r14";
+    reg64_name[13] = "r15";
+    reg32_name[0] = "eax";
+    reg32_name[1] = "ebx";
+    reg32_name[2] = "ecx";
+    reg32_name[3] = "edx";
+    reg32_name[4] = "esi";
+    reg32_name[5] = "edi";
+    reg32_name[6] = "r8d";
+    reg32_name[7] = "r9d";
+    reg32_name[8] = "r10d";
+    reg32_name[9] = "r11d";
+    reg32_name[10] = "r12d";
+    reg32_name[11] = "r13d";
+    reg32_name[12] = "r14d";
+    reg32_name[13] = "r15d";
+}
+
+void ins_reserve (int max) {
+    if (max > ins_cap) {
+        ins_op = grow(ins_op, ins_cap, max + max, WORD_SIZE);
+        ins_name = grow(ins_name, ins_cap, max + max, PTR_SIZE);
+        ins_a = grow(ins_a, ins_cap, max + max, PTR_SIZE);
+        ins_b = grow(ins_b, ins_cap, max + max, PTR_SIZE);
+        ins_cap = max + max;
+    }
+}
+
+///至少n个字节的空间，写完之后交给ins_keep
+//Nothing else may take space in between, so a string is kept before it
+//goes into a call whose other arguments build strings too: mini-c
+//evaluates arguments from left to right, gcc does not.
+char* ins_space (int n) {
+    if (ins_pool_used + n + 1 > ins_pool_size)
+    {
+        ins_pool_size = n + 1 > ARENA_CHUNK ? n + 1 : ARENA_CHUNK;
+        ins_pool = malloc(ins_pool_size);
+        ins_pool_used = 0;
+
+        if (ins_pool_no == ins_pool_cap)
+        {
+            ins_pool_chunks = grow(ins_pool_chunks, ins_pool_no, ins_pool_cap + ins_pool_cap + 16, PTR_SIZE);
+            ins_pool_cap = ins_pool_cap + ins_pool_cap + 16;
+        }
+
+        ins_pool_chunks[ins_pool_no++] = ins_pool;
+    }
+
+    return ins_pool + ins_pool_used;
+}
+
+///ins_space给的空间写到了end，留下这段文本
+char* ins_keep (char* end) {
+    char* start = ins_pool + ins_pool_used;
+
+    end[0] = 0;
+    ins_pool_used = end + 1 - ins_pool;
+    return start;
+}
+
+char* ins_copy (char* s) {
+    if (s == 0)
+        return 0;
+
+    return ins_keep(put_text(ins_space(strlen(s)), s));
+}
+
+char* ins_number (int n) {
+    return ins_keep(put_digits(ins_space(12), n, 1));
+}
+
+///[base+off]
+char* ins_mem (char* base, int off) {
+    char* p = ins_space(strlen(base) + 16);
+
+    p = put_text(p, "[");
+    p = put_text(p, base);
+    p = put_disp(p, off);
+    return ins_keep(put_text(p, "]"));
+}
+
+char* ins_join (char* a, char* b) {
+    char* p = ins_space(strlen(a) + strlen(b));
+    return ins_keep(put_text(put_text(p, a), b));
+}
+
+///下一个函数从头用起。第一块留着，大多数函数只用它
+void ins_pool_reset () {
+    int i = 0;
+
+    for (i = 1; i < ins_pool_no; i++)
+        free(ins_pool_chunks[i]);
+
+    if (ins_pool_no > 1)
+    {
+        ins_pool_no = 1;
+        ins_pool = ins_pool_chunks[0];
+        ins_pool_size = ARENA_CHUNK;
+    }
+
+    ins_pool_used = 0;
+}
+
+void peep_begin () {
+    ins_pool_reset();
+
+    if (!peephole)
+        return;
+
+    ins_no = 0;
+    ins_capture = true;
+}
+
+char* skip_blanks (char* p) {
+    while (p[0] == ' ' || p[0] == '\t')
+        p++;
+
+    return p;
+}
+
+void trim_end (char* s) {
+    int n = strlen(s);
+
+    while (n > 0 && (s[n-1] == ' ' || s[n-1] == '\t')) {
+        n--;
+        s[n] = 0;
+    }
+}
+
+int ins_classify (char* name) {
+    if (strcmp(name, "mov") == 0)
+        return OP_MOV;
+
+    if (strcmp(name, "push") == 0)
+        return OP_PUSH;
+
+    if (strcmp(name, "pop") == 0)
+        return OP_POP;
+
+    if (strcmp(name, "cmp") == 0)
+        return OP_CMP;
+
+    if (strcmp(name, "jmp") == 0)
+        return OP_JMP;
+
+    if (name[0] == 'j')
+        return OP_JCC;
+
+    if (strncmp(name, "set", 3) == 0)
+        return OP_SETCC;
+
+    return OP_OTHER;
+}
+
+///加一条指令。name不拷贝，它是字面量或者表中的名字
+void ins_add (char* name, char* a, char* b) {
+    ins_reserve(ins_no + 1);
+    ins_op[ins_no] = ins_classify(name);
+    ins_name[ins_no] = name;
+    ins_a[ins_no] = a;
+    ins_b[ins_no] = b;
+    ins_no++;
+}
+
+void ins_label (char* name) {
+    ins_add(name, name, 0);
+    ins_op[ins_no-1] = OP_LABEL;
+}
+
+void ins_note (char* text) {
+    ins_add(text, 0, 0);
+    ins_op[ins_no-1] = OP_NOTE;
+}
+
+///把一行汇编拆成助记符和操作数
+void ins_parse (char* line) {
+    char* p = skip_blanks(line);
+    int n = strlen(p);
+    bool quote = false;
+
+    if (n == 0)
+        return;
+
+    ins_name[ins_no] = line;
+    ins_a[ins_no] = 0;
+    ins_b[ins_no] = 0;
+
+    if (p[0] == ';')
+        ins_op[ins_no] = OP_NOTE;
+
+    else if (p[n-1] == ':')
+    {
+        p[n-1] = 0;
+        ins_op[ins_no] = OP_LABEL;
+        ins_a[ins_no] = p;
+    }
+    else
+    {
+        ins_name[ins_no] = p;
+
+        while (p[0] != ' ' && p[0] != '\t' && p[0] != 0)
+            p++;
+
+        if (p[0] != 0) {
+            p[0] = 0;
+            p = skip_blanks(p+1);
+        }
+
+        if (p[0] != 0)
+        {
+            ins_a[ins_no] = p;
+
+            //A character literal may be a comma
+            while (p[0] != 0 && (quote || p[0] != ',')) {
+                if (p[0] == '\'')
+                    quote = !quote;
+
+                p++;
+            }
+
+            if (p[0] != 0) {
+                p[0] = 0;
+                ins_b[ins_no] = skip_blanks(p+1);
+                trim_end(ins_b[ins_no]);
+            }
+
+            trim_end(ins_a[ins_no]);
+        }
+
+        ins_op[ins_no] = ins_classify(ins_name[ins_no]);
+    }
+
+    ins_no++;
+}
+
+void ins_reverse (int from, int to) {
+    int op = 0;
+    char* name = 0;
+    char* a = 0;
+    char* b = 0;
+
+    for (to--; from < to; to--)
+    {
+        op = ins_op[from];
+        name = ins_name[from];
+        a = ins_a[from];
+        b = ins_b[from];
+        ins_op[from] = ins_op[to];
+        ins_name[from] = ins_name[to];
+        ins_a[from] = ins_a[to];
+        ins_b[from] = ins_b[to];
+        ins_op[to] = op;
+        ins_name[to] = name;
+        ins_a[to] = a;
+        ins_b[to] = b;
+        from++;
+    }
+}
+
+///从mid到最后的指令移到start前面，就像流式生成时把函数体取出来放到函数头后面
+void ins_move_before (int start, int mid) {
+    ins_reverse(start, mid);
+    ins_reverse(mid, ins_no);
+    ins_reverse(start, ins_no);
+}
+
+void ins_write () {
+    int i = 0;
+    int op = 0;
+
+    for (i = 0; i < ins_no; i++)
+    {
+        op = ins_op[i];
+
+        if (op == OP_LABEL)
+        {
+            emit(ins_name[i]);
+            emit(":\n");
+        }
+        else if (op == OP_NOTE)
+        {
+            emit(ins_name[i]);
+            emit_char('\n');
+        }
+        else if (op != OP_DEAD)
+            emit_ins(ins_name[i], ins_a[i], ins_b[i]);
+    }
+}
+
+///下一条指令，跳过删除的和注释
+int ins_next (int i) {
+    i++;
+
+    while (i < ins_no && (ins_op[i] == OP_DEAD || ins_op[i] == OP_NOTE))
+        i++;
+
+    return i;
+}
+
+bool same (char* a, char* b) {
+    return a != 0 && b != 0 && strcmp(a, b) == 0;
+}
+
+bool is_reg (char* s) {
+    return s != 0 && s[0] == 'r' && strchr(s, '[') == 0;
+}
+
+///操作数中是否出现了某个寄存器
+bool mentions (char* s, char* reg) {
+    int n = strlen(reg);
+    bool found = false;
+
+    while (s[0] != 0) {
+        if (strncmp(s, reg, n) == 0)
+            found = true;
+
+        s++;
+    }
+
+    return found;
+}
+
+char* reg32 (char* reg) {
+    int i = 0;
+    char* name = 0;
+
+    for (i = 0; i < REG_NAMES; i++)
+        if (same(reg, reg64_name[i]))
+            name = reg32_name[i];
+
+    return name;
+}
+
+bool sets_flags (int i) {
+    char* name = ins_name[i];
+
+    return ins_op[i] == OP_CMP || strcmp(name, "test") == 0 || strcmp(name, "add") == 0
+        || strcmp(name, "sub") == 0 || strcmp(name, "and") == 0 || strcmp(name, "xor") == 0
+        || strcmp(name, "imul") == 0 || strcmp(name, "neg") == 0 || strcmp(name, "call") == 0
+        || strcmp(name, "ret") == 0;
+}
+
+///第i条指令之后，标志位在被读之前就会被改写
+bool flags_dead (int i) {
+    int j = ins_next(i);
+
+    while (j < ins_no && (ins_op[j] == OP_MOV || ins_op[j] == OP_PUSH || ins_op[j] == OP_POP
+                          || strcmp(ins_name[j], "lea") == 0 || strcmp(ins_name[j], "movzx") == 0))
+        j = ins_next(j);
+
+    return j < ins_no && ins_op[j] != OP_LABEL && ins_op[j] != OP_DEAD && sets_flags(j);
+}
+
+///在第i条指令处尝试一条规则，改写了就返回true
+bool peep_rule (int rule, int i) {
+    int op = ins_op[i];
+    int j = ins_next(i);
+    int k = ins_next(j);
+
+    if (rule == PEEP_PUSH_POP)
+    {
+        //push A; pop D  =>  mov D, A
+        if (op != OP_PUSH || ins_op[j] != OP_POP)
+            return false;
+
+        if (same(ins_a[i], ins_a[j]))
+        {
+            ins_op[i] = OP_DEAD;
+            peep_removed[rule]++;
+        }
+        else
+        {
+            ins_op[i] = OP_MOV;
+            ins_name[i] = "mov";
+            ins_b[i] = ins_a[i];
+            ins_a[i] = ins_a[j];
+        }
+
+        ins_op[j] = OP_DEAD;
+        peep_removed[rule]++;
+        return true;
+    }
+    else if (rule == PEEP_PUSH_MOV_POP)
+    {
+        //push A; mov B, C; pop D  =>  mov D, A; mov B, C
+        if (op != OP_PUSH || ins_op[j] != OP_MOV || ins_op[k] != OP_POP)
+            return false;
+
+        if (!is_reg(ins_a[j]) || same(ins_a[j], ins_a[k]) || mentions(ins_b[j], ins_a[k])
+            || mentions(ins_b[j], "rsp") || mentions(ins_a[i], "rsp"))
+            return false;
+
+        ins_op[i] = OP_MOV;
+        ins_name[i] = "mov";
+        ins_b[i] = ins_a[i];
+        ins_a[i] = ins_a[k];
+        ins_op[k] = OP_DEAD;
+        peep_removed[rule]++;
+        return true;
+    }
+    else if (rule == PEEP_STORE_LOAD)
+    {
+        //mov X, Y; mov Y, X  =>  mov X, Y
+        if (op != OP_MOV || ins_op[j] != OP_MOV)
+            return false;
+
+        if (!same(ins_a[i], ins_b[j]) || !same(ins_b[i], ins_a[j]))
+            return false;
+
+        if (is_reg(ins_a[i]) && mentions(ins_b[i], ins_a[i]))
+            return false;
+
+        ins_op[j] = OP_DEAD;
+        peep_removed[rule]++;
+        return true;
+    }
+    else if (rule == PEEP_CMP_JCC_CMP)
+    {
+        //A conditional jump leaves the flags as they were
+        if (op != OP_CMP || ins_op[j] != OP_JCC || ins_op[k] != OP_CMP)
+            return false;
+
+        if (!same(ins_a[i], ins_a[k]) || !same(ins_b[i], ins_b[k]))
+            return false;
+
+        ins_op[k] = OP_DEAD;
+        peep_removed[rule]++;
+        return true;
+    }
+    else if (rule == PEEP_JMP_NEXT)
+    {
+        if (op != OP_JMP)
+            return false;
+
+        while (ins_op[j] == OP_LABEL && !same(ins_a[j], ins_a[i]))
+            j = ins_next(j);
+
+        if (ins_op[j] != OP_LABEL)
+            return false;
+
+        ins_op[i] = OP_DEAD;
+        peep_removed[rule]++;
+        return true;
+    }
+    else if (rule == PEEP_ZERO_XOR)
+    {
+        if (op != OP_MOV || !same(ins_b[i], "0") || reg32(ins_a[i]) == 0 || !flags_dead(i))
+            return false;
+
+        ins_op[i] = OP_OTHER;
+        ins_name[i] = "xor";
+        ins_a[i] = reg32(ins_a[i]);
+        ins_b[i] = ins_a[i];
+        peep_rewrote[rule]++;
+        return true;
+    }
+
+    return false;
+}
+
+void peep_end () {
+    bool changed = true;
+    int i = 0;
+    int rule = 0;
+
+    if (!peephole)
+        return;
+
+    ins_capture = false;
+
+    //Sentinels, so that rules can look two instructions past the end
+    ins_reserve(ins_no + 3);
+    ins_op[ins_no] = OP_DEAD;
+    ins_op[ins_no+1] = OP_DEAD;
+    ins_op[ins_no+2] = OP_DEAD;
+
+    while (changed) {
+        changed = false;
+
+        for (i = 0; i < ins_no; i++)
+        {
+            for (rule = 0; rule < PEEP_RULES; rule++)
+            {
+                if (ins_op[i] != OP_DEAD && ins_op[i] != OP_NOTE && peep_rule(rule, i))
+                    changed = true;
+            }
+        }
+    }
+
+    ins_write();
+}
+
+//==== Object file writer ====
+
+///-c：不输出汇编文本，直接编码成ELF64目标文件a.o
+//With -c the text in the output buffer is not written out but assembled
+//here, a block at a time, into machine code. Only the instruction forms
+//the code generator emits are known. Jumps and calls within .text are
+//patched at the end; references to data and to library functions
+//become relocations.
+
+///段，和ELF中的段号相同；0号用来拼整个文件
+int SEC_TEXT = 1;
+int SEC_DATA = 2;
+int SEC_RODATA = 3;
+int SEC_SYMTAB = 4;
+int SEC_STRTAB = 5;
+int SEC_RELA = 6;
+int SEC_SHSTRTAB = 7;
+int SEC_NOTE = 8;
+int SECS = 9;
+
+char** sec_buf;
+int* sec_len;
+int* sec_cap;
+int* sec_name;
+int* sec_offset;
+int asm_sec = 1;
+
+///小端字节序：整数存进这里，再逐个字节拷出去
+//mini-c ints are 8 bytes and gcc's are 4, but the low bytes agree
+void* le_buf;
+int* le_word;
+char* le_bytes;
+
+///sscanf的格式，不写成字面量，否则gcc会拿它去检查void*的le_buf
+char* dec_format;
+char* hex_format;
+
+///寄存器，按指令编码中的编号
+char** asm_reg64;
+char** asm_reg32;
+char** asm_reg8;
+
+///一条指令的两个操作数
+int OPD_REG = 1;
+int OPD_IMM = 2;
+int OPD_MEM = 3;
+int OPD_SYM = 4;
+
+int* opd_kind;
+int* opd_reg;
+int* opd_size;
+int* opd_imm;
+bool* opd_wide;    // the immediate needs all 64 bits, see read_number
+int* opd_base;     // -1 for rip relative
+int* opd_index;    // -1 for none
+int* opd_scale;
+int* opd_disp;
+int* opd_target;   // a label number, or a symbol
+bool* opd_label;
+
+char* asm_word;
+
+///标号和符号定义的位置，段号为0表示还没定义
+int* label_sec;
+int* label_pos;
+int label_cap = 0;
+
+int* sym_sec;
+int* sym_pos;
+int* sym_index;
+
+///.text中还没填的rel32
+int* fix_pos;
+int* fix_target;
+int* fix_label;
+int* fix_addend;
+int* fix_call;
+int fix_no = 0;
+int fix_cap = 0;
+
+int R_X86_64_PC32 = 2;
+int R_X86_64_PLT32 = 4;
+
+void obj_init () {
+    int i = 0;
+
+    //The buffers of the last compilation, if there was one
+    if (sec_buf)
+    {
+        for (i = 0; i < SECS; i++)
+            free(sec_buf[i]);
+    }
+
+    sec_buf = renew(sec_buf, SECS, PTR_SIZE);
+    sec_len = renew(sec_len, SECS, WORD_SIZE);
+    sec_cap = renew(sec_cap, SECS, WORD_SIZE);
+    sec_name = renew(sec_name, SECS, WORD_SIZE);
+    sec_offset = renew(sec_offset, SECS, WORD_SIZE);
+
+    asm_sec = SEC_TEXT;
+    fix_no = 0;
+
+    for (i = 0; i < SECS; i++)
+    {
+        sec_cap[i] = 4096;
+        sec_buf[i] = malloc(4096);
+    }
+
+    free(le_buf);
+    le_buf = malloc(16);
+    le_word = le_buf;
+    le_bytes = le_buf;
+    dec_format = "%lld";
+    hex_format = "%llx";
+
+    asm_reg64 = renew(asm_reg64, 16, PTR_SIZE);
+    asm_reg32 = renew(asm_reg32, 16, PTR_SIZE);
+    asm_reg8 = renew(asm_reg8, 4, PTR_SIZE);
+    asm_reg64[0] = "rax";
+    asm_reg64[1] = "rcx";
+    asm_reg64[2] = "rdx";
+    asm_reg64[3] = "rbx";
+    asm_reg64[4] = "rsp";
+    asm_reg64[5] = "rbp";
+    asm_reg64[6] = "rsi";
+    asm_reg64[7] = "rdi";
+    asm_reg32[0] = "eax";
+    asm_reg32[1] = "ecx";
+    asm_reg32[2] = "edx";
+    asm_reg32[3] = "ebx";
+    asm_reg32[4] = "esp";
+    asm_reg32[5] = "ebp";
+    asm_reg32[6] = "esi";
+    asm_reg32[7] = "edi";
+    asm_reg64[8] = "r8";
+    asm_reg64[9] = "r9";
+    asm_reg64[10] = "r10";
+    asm_reg64[11] = "r11";
+    asm_reg64[12] = "r12";
+    asm_reg64[13] = "r13";
+    asm_reg64[14] = "r14";
+    asm_reg64[15] = "r15";
+    asm_reg32[8] = "r8d";
+    asm_reg32[9] = "r9d";
+    asm_reg32[10] = "r10d";
+    asm_reg32[11] = "r11d";
+    asm_reg32[12] = "r12d";
+    asm_reg32[13] = "r13d";
+    asm_reg32[14] = "r14d";
+    asm_reg32[15] = "r15d";
+    asm_reg8[0] = "al";
+    asm_reg8[1] = "cl";
+    asm_reg8[2] = "dl";
+    asm_reg8[3] = "bl";
+
+    opd_kind = renew(opd_kind, 2, WORD_SIZE);
+    opd_reg = renew(opd_reg, 2, WORD_SIZE);
+    opd_size = renew(opd_size, 2, WORD_SIZE);
+    opd_imm = renew(opd_imm, 2, WORD_SIZE);
+    opd_base = renew(opd_base, 2, WORD_SIZE);
+    opd_index = renew(opd_index, 2, WORD_SIZE);
+    opd_scale = renew(opd_scale, 2, WORD_SIZE);
+    opd_disp = renew(opd_disp, 2, WORD_SIZE);
+    opd_target = renew(opd_target, 2, WORD_SIZE);
+    opd_label = renew(opd_label, 2, WORD_SIZE);
+    opd_wide = renew(opd_wide, 2, WORD_SIZE);
+    free(asm_word);
+    asm_word = malloc(256);
+
+    label_cap = 1024;
+    label_sec = renew(label_sec, label_cap, WORD_SIZE);
+    label_pos = renew(label_pos, label_cap, WORD_SIZE);
+
+    sym_sec = renew(sym_sec, sym_cap, WORD_SIZE);
+    sym_pos = renew(sym_pos, sym_cap, WORD_SIZE);
+    sym_index = renew(sym_index, sym_cap, WORD_SIZE);
+
+    fix_cap = 1024;
+    fix_pos = renew(fix_pos, fix_cap, WORD_SIZE);
+    fix_target = renew(fix_target, fix_cap, WORD_SIZE);
+    fix_label = renew(fix_label, fix_cap, WORD_SIZE);
+    fix_addend = renew(fix_addend, fix_cap, WORD_SIZE);
+    fix_call = renew(fix_call, fix_cap, WORD_SIZE);
+}
+
+void obj_grow (int len, int cap) {
+    sym_sec = grow(sym_sec, len, cap, WORD_SIZE);
+    sym_pos = grow(sym_pos, len, cap, WORD_SIZE);
+    sym_index = grow(sym_index, len, cap, WORD_SIZE);
+}
+
+void sec_reserve (int sec, int n) {
+    char* old = sec_buf[sec];
+
+    if (sec_len[sec] + n > sec_cap[sec])
+    {
+        while (sec_len[sec] + n > sec_cap[sec])
+            sec_cap[sec] = sec_cap[sec]*2;
+
+        sec_buf[sec] = malloc(sec_cap[sec]);
+        memcpy(sec_buf[sec], old, sec_len[sec]);
+        free(old);
+    }
+}
+
+void put_byte (int sec, int b) {
+    char* p = 0;
+
+    sec_reserve(sec, 1);
+    p = sec_buf[sec];
+    p[sec_len[sec]] = b;
+    sec_len[sec] = sec_len[sec] + 1;
+}
+
+///size个字节的小端整数
+void put_le (int sec, int value, int size) {
+    int i = 0;
+
+    le_word[0] = value;
+    le_word[1] = value < 0 ? -1 : 0;
+
+    for (i = 0; i < size; i++)
+        put_byte(sec, le_bytes[i]);
+}
+
+void put_zeros (int sec, int n) {
+    while (n > 0) {
+        put_byte(sec, 0);
+        n--;
+    }
+}
+
+void put_bytes (int sec, char* data, int n) {
+    char* p = 0;
+
+    sec_reserve(sec, n);
+    p = sec_buf[sec];
+    memcpy(p + sec_len[sec], data, n);
+    sec_len[sec] = sec_len[sec] + n;
+}
+
+void patch32 (int sec, int pos, int value) {
+    char* p = sec_buf[sec] + pos;
+    int i = 0;
+
+    le_word[0] = value;
+
+    for (i = 0; i < 4; i++)
+        p[i] = le_bytes[i];
+}
+
+//==== Instruction encoding ====
+
+int asm_reg (char* name, char** table, int n) {
+    int i = 0;
+    int reg = -1;
+
+    for (i = 0; i < n && reg < 0; i++)
+        if (strcmp(name, table[i]) == 0)
+            reg = i;
+
+    return reg;
+}
+
+///按64位读一个数，8个字节都在le_bytes里，返回的int是低位
+//gcc's int has 32 bits, so only le_bytes holds all of a wide number. The
+//int returned is the whole of it in mini-c and its low half in gcc.
+int read_number (char* s) {
+    int n = s[0] == '-' ? 1 : 0;
+
+    while (char_class[s[n] & 255] == CC_DIGIT)
+        n++;
+
+    //Most numbers are short, and atoi is much faster than sscanf. The high
+    //word is the sign, as in put_le()
+    if (n < 10 && s[n] != 'x')
+    {
+        le_word[0] = atoi(s);
+        le_word[1] = le_word[0] < 0 ? -1 : 0;
+        return le_word[0];
+    }
+
+    sscanf(s, s[0] == '0' && s[1] == 'x' ? hex_format : dec_format, le_buf);
+    return le_word[0];
+}
+
+///刚读的数符号扩展以后是否等于它的低32位
+bool number_fits () {
+    int sign = (le_bytes[3] & 128) ? 255 : 0;
+    int i = 0;
+    bool fits = true;
+
+    for (i = 4; i < 8; i++)
+    {
+        if ((le_bytes[i] & 255) != sign)
+            fits = false;
+    }
+
+    return fits;
+}
+
+///标号（_00000012）或者符号
+void asm_target (int i, char* name) {
+    opd_label[i] = name[0] == '_' && char_class[name[1] & 255] == CC_DIGIT;
+
+    if (opd_label[i])
+        opd_target[i] = atoi(name+1);
+
+    else
+    {
+        opd_target[i] = sym_lookup(name);
+
+        if (opd_target[i] < 0) {
+            report(0, diag_format("undefined symbol %s", name, ""));
+            opd_target[i] = 0;
+        }
+    }
+}
+
+///读一个名字到asm_word，返回后面的位置
+char* asm_name (char* p) {
+    int n = 0;
+
+    while (char_class[p[0] & 255] >= CC_ALPHA) {
+        asm_word[n++] = p[0];
+        p++;
+    }
+
+    asm_word[n] = 0;
+    return p;
+}
+
+///[base+disp]，[index*scale+base]，[name]
+void asm_memory (int i, char* p) {
+    int reg = 0;
+
+    opd_kind[i] = OPD_MEM;
+    p = asm_name(p);
+    reg = asm_reg(asm_word, asm_reg64, 16);
+
+    if (p[0] == '*')
+    {
+        opd_index[i] = reg;
+        opd_scale[i] = (p[1] & 255) - '0';
+        p = asm_name(p+3);
+        reg = asm_reg(asm_word, asm_reg64, 16);
+    }
+
+    if (reg < 0)
+        asm_target(i, asm_word);
+
+    opd_base[i] = reg;
+
+    if (p[0] == '+' || p[0] == '-')
+        opd_disp[i] = atoi(p);
+}
+
+void asm_operand (int i, char* s) {
+    int reg = 0;
+
+    opd_kind[i] = 0;
+    opd_size[i] = 8;
+    opd_base[i] = -1;
+    opd_index[i] = -1;
+    opd_scale[i] = 1;
+    opd_disp[i] = 0;
+    opd_wide[i] = false;
+
+    if (s == 0)
+        return;
+
+    if (strncmp(s, "qword ", 6) == 0)
+        s = s+6;
+
+    else if (strncmp(s, "byte ", 5) == 0) {
+        s = s+5;
+        opd_size[i] = 1;
+    }
+
+    if (s[0] == '[')
+        asm_memory(i, s+1);
+
+    else if (s[0] == '\'')
+    {
+        opd_kind[i] = OPD_IMM;
+        opd_imm[i] = s[1] & 255;
+    }
+    else if (s[0] == '-' || char_class[s[0] & 255] == CC_DIGIT)
+    {
+        opd_kind[i] = OPD_IMM;
+        opd_imm[i] = read_number(s);
+        opd_wide[i] = !number_fits();
+    }
+    else
+    {
+        opd_kind[i] = OPD_REG;
+        reg = asm_reg(s, asm_reg64, 16);
+
+        if (reg < 0) {
+            reg = asm_reg(s, asm_reg32, 16);
+            opd_size[i] = 4;
+        }
+
+        if (reg < 0) {
+            reg = asm_reg(s, asm_reg8, 4);
+            opd_size[i] = 1;
+        }
+
+        opd_reg[i] = reg;
+
+        if (reg < 0) {
+            opd_kind[i] = OPD_SYM;
+            asm_target(i, s);
+        }
+    }
+}
+
+void asm_fixup (int i, int addend, bool call) {
+    if (fix_no == fix_cap)
+    {
+        fix_pos = grow(fix_pos, fix_no, fix_cap*2, WORD_SIZE);
+        fix_target = grow(fix_target, fix_no, fix_cap*2, WORD_SIZE);
+        fix_label = grow(fix_label, fix_no, fix_cap*2, WORD_SIZE);
+        fix_addend = grow(fix_addend, fix_no, fix_cap*2, WORD_SIZE);
+        fix_call = grow(fix_call, fix_no, fix_cap*2, WORD_SIZE);
+        fix_cap = fix_cap*2;
+    }
+
+    fix_pos[fix_no] = sec_len[SEC_TEXT];
+    fix_target[fix_no] = opd_target[i];
+    fix_label[fix_no] = opd_label[i];
+    fix_addend[fix_no] = addend;
+    fix_call[fix_no] = call;
+    fix_no++;
+    put_le(SEC_TEXT, 0, 4);
+}
+
+///REX前缀：reg是ModRM的reg字段，i是r/m操作数
+void asm_rex (bool wide, int reg, int i) {
+    int rex = wide ? 72 : 64;
+
+    if (reg > 7)
+        rex = rex + 4;
+
+    if (opd_kind[i] == OPD_MEM && opd_index[i] > 7)
+        rex = rex + 2;
+
+    if ((opd_kind[i] == OPD_REG && opd_reg[i] > 7) || (opd_kind[i] == OPD_MEM && opd_base[i] > 7))
+        rex = rex + 1;
+
+    if (rex != 64)
+        put_byte(SEC_TEXT, rex);
+}
+
+///ModRM，SIB和位移。trailing是后面立即数的字节数，rip相对的位移要算上它
+void asm_modrm (int reg, int i, int trailing) {
+    int mod = 0;
+    int base = opd_base[i];
+    int index = opd_index[i];
+    int disp = opd_disp[i];
+    int scale = 0;
+
+    reg = (reg & 7)*8;
+
+    if (opd_kind[i] == OPD_REG)
+    {
+        put_byte(SEC_TEXT, 192 + reg + (opd_reg[i] & 7));
+        return;
+    }
+
+    if (base < 0)
+    {
+        put_byte(SEC_TEXT, reg + 5);
+        asm_fixup(i, disp - 4 - trailing, false);
+        return;
+    }
+
+    //[rbp] and [r13] have no form without a displacement
+    if (disp != 0 || (base & 7) == 5)
+        mod = (disp < -128 || disp > 127) ? 128 : 64;
+
+    if (index < 0 && (base & 7) != 4)
+        put_byte(SEC_TEXT, mod + reg + (base & 7));
+
+    else
+    {
+        if (index < 0)
+            index = 4;
+
+        if (opd_scale[i] == 8)
+            scale = 192;
+        else if (opd_scale[i] == 4)
+            scale = 128;
+        else if (opd_scale[i] == 2)
+            scale = 64;
+
+        put_byte(SEC_TEXT, mod + reg + 4);
+        put_byte(SEC_TEXT, scale + ((index & 7)*8) + (base & 7));
+    }
+
+    if (mod == 64)
+        put_byte(SEC_TEXT, disp);
+
+    else if (mod == 128)
+        put_le(SEC_TEXT, disp, 4);
+}
+
+///op reg, r/m。两字节的操作码写成0x0Fxx
+void asm_rm (bool wide, int op, int reg, int i, int trailing) {
+    asm_rex(wide, reg, i);
+
+    if (op > 255) {
+        put_byte(SEC_TEXT, 15);
+        op = op - 3840;
+    }
+
+    put_byte(SEC_TEXT, op);
+    asm_modrm(reg, i, trailing);
+}
+
+bool fits_byte (int imm) {
+    return imm > -129 && imm < 128;
+}
+
+///add r/m, imm之类：imm能放进一个字节就用0x83
+void asm_rm_imm (bool wide, int ext, int i, int imm) {
+    if (fits_byte(imm))
+    {
+        asm_rm(wide, 131, ext, i, 1);
+        put_byte(SEC_TEXT, imm);
+    }
+    else
+    {
+        asm_rm(wide, 129, ext, i, 4);
+        put_le(SEC_TEXT, imm, 4);
+    }
+}
+
+///算术指令在操作码表中的行
+int asm_alu (char* name) {
+    if (strcmp(name, "add") == 0)
+        return 0;
+
+    if (strcmp(name, "or") == 0)
+        return 1;
+
+    if (strcmp(name, "and") == 0)
+        return 4;
+
+    if (strcmp(name, "sub") == 0)
+        return 5;
+
+    if (strcmp(name, "xor") == 0)
+        return 6;
+
+    if (strcmp(name, "cmp") == 0)
+        return 7;
+
+    return -1;
+}
+
+///条件码
+int asm_cc (char* cc) {
+    if (strcmp(cc, "e") == 0 || strcmp(cc, "z") == 0)
+        return 4;
+
+    if (strcmp(cc, "ne") == 0 || strcmp(cc, "nz") == 0)
+        return 5;
+
+    if (strcmp(cc, "l") == 0)
+        return 12;
+
+    if (strcmp(cc, "ge") == 0)
+        return 13;
+
+    if (strcmp(cc, "le") == 0)
+        return 14;
+
+    if (strcmp(cc, "g") == 0)
+        return 15;
+
+    return -1;
+}
+
+void asm_ins (char* name, char* a, char* b) {
+    int left = 0;
+    int right = 0;
+    int reg = 0;
+    int imm = 0;
+    int ext = asm_alu(name);
+    int cc = -1;
+
+    asm_operand(0, a);
+    asm_operand(1, b);
+    left = opd_kind[0];
+    right = opd_kind[1];
+    reg = opd_reg[0];
+    imm = opd_imm[1];
+
+    if (name[0] == 'j' && strcmp(name, "jmp") != 0)
+        cc = asm_cc(name+1);
+
+    else if (strncmp(name, "set", 3) == 0)
+        cc = asm_cc(name+3);
+
+    //Only mov to a register takes 64 bits of immediate
+    if (right == OPD_IMM && opd_wide[1] && (left != OPD_REG || strcmp(name, "mov") != 0))
+        report(0, diag_format("immediate %s does not fit in 32 bits", b, ""));
+
+    if (ext >= 0 && right == OPD_IMM)
+        asm_rm_imm(opd_size[0] == 8, ext, 0, imm);
+
+    else if (ext >= 0 && right == OPD_REG)
+        asm_rm(opd_size[1] == 8, (ext*8) + 1, opd_reg[1], 0, 0);
+
+    else if (ext >= 0)
+        asm_rm(true, (ext*8) + 3, reg, 1, 0);
+
+    else if (strcmp(name, "mov") == 0)
+    {
+        //mov r64, imm64 (movabs), the number is still in le_bytes
+        if (left == OPD_REG && right == OPD_IMM && opd_wide[1])
+        {
+            put_byte(SEC_TEXT, reg > 7 ? 73 : 72);
+            put_byte(SEC_TEXT, 184 + (reg & 7));
+            put_bytes(SEC_TEXT, le_bytes, 8);
+        }
+        //mov r32, imm zero extends, and is shorter
+        else if (left == OPD_REG && right == OPD_IMM && imm >= 0)
+        {
+            if (reg > 7)
+                put_byte(SEC_TEXT, 65);
+
+            put_byte(SEC_TEXT, 184 + (reg & 7));
+            put_le(SEC_TEXT, imm, 4);
+        }
+        else if (right == OPD_IMM)
+        {
+            asm_rm(true, 199, 0, 0, 4);
+            put_le(SEC_TEXT, imm, 4);
+        }
+        else if (right == OPD_REG)
+            asm_rm(opd_size[1] == 8, opd_size[1] == 1 ? 136 : 137, opd_reg[1], 0, 0);
+
+        else
+            asm_rm(true, 139, reg, 1, 0);
+    }
+    else if (strcmp(name, "lea") == 0)
+        asm_rm(true, 141, reg, 1, 0);
+
+    else if (strcmp(name, "push") == 0 && left == OPD_REG)
+    {
+        if (reg > 7)
+            put_byte(SEC_TEXT, 65);
+
+        put_byte(SEC_TEXT, 80 + (reg & 7));
+    }
+    else if (strcmp(name, "push") == 0)
+        asm_rm(false, 255, 6, 0, 0);
+
+    else if (strcmp(name, "pop") == 0)
+    {
+        if (reg > 7)
+            put_byte(SEC_TEXT, 65);
+
+        put_byte(SEC_TEXT, 88 + (reg & 7));
+    }
+    else if (strcmp(name, "call") == 0 && left == OPD_SYM)
+    {
+        put_byte(SEC_TEXT, 232);
+        asm_fixup(0, -4, true);
+    }
+    else if (strcmp(name, "call") == 0)
+        asm_rm(false, 255, 2, 0, 0);
+
+    else if (strcmp(name, "jmp") == 0)
+    {
+        put_byte(SEC_TEXT, 233);
+        asm_fixup(0, -4, false);
+    }
+    else if (name[0] == 'j' && cc >= 0)
+    {
+        put_byte(SEC_TEXT, 15);
+        put_byte(SEC_TEXT, 128 + cc);
+        asm_fixup(0, -4, false);
+    }
+    else if (name[0] == 's' && cc >= 0)
+        asm_rm(false, 3984 + cc, 0, 0, 0);
+
+    else if (strcmp(name, "ret") == 0)
+        put_byte(SEC_TEXT, 195);
+
+    else if (strcmp(name, "imul") == 0 && right == OPD_IMM)
+    {
+        if (fits_byte(imm))
+        {
+            asm_rm(true, 107, reg, 0, 1);
+            put_byte(SEC_TEXT, imm);
+        }
+        else
+        {
+            asm_rm(true, 105, reg, 0, 4);
+            put_le(SEC_TEXT, imm, 4);
+        }
+    }
+    else if (strcmp(name, "imul") == 0)
+        asm_rm(true, 4015, reg, 1, 0);
+
+    else if (strcmp(name, "neg") == 0)
+        asm_rm(true, 247, 3, 0, 0);
+
+    else if (strcmp(name, "shl") == 0)
+    {
+        asm_rm(true, 193, 4, 0, 1);
+        put_byte(SEC_TEXT, imm);
+    }
+    else if (strcmp(name, "rdtsc") == 0)
+    {
+        put_byte(SEC_TEXT, 15);
+        put_byte(SEC_TEXT, 49);
+    }
+
+    else if (strcmp(name, "movsxd") == 0)
+        asm_rm(true, 99, reg, 1, 0);
+
+    else if (strcmp(name, "movzx") == 0)
+        asm_rm(false, 4022, reg, 1, 0);
+
+    else
+    {
+        report(0, diag_format("cannot encode %s", name, ""));
+    }
+}
+
+//==== Assembling the text ====
+
+///标号或符号定义在当前段的当前位置
+void asm_define (char* name) {
+    int label = 0;
+    int sym = 0;
+
+    if (name[0] == '_' && char_class[name[1] & 255] == CC_DIGIT)
+    {
+        label = atoi(name+1);
+
+        if (label >= label_cap)
+        {
+            label_sec = grow(label_sec, label_cap, label + label_cap, WORD_SIZE);
+            label_pos = grow(label_pos, label_cap, label + label_cap, WORD_SIZE);
+            label_cap = label + label_cap;
+        }
+
+        label_sec[label] = asm_sec;
+        label_pos[label] = sec_len[asm_sec];
+    }
+    else
+    {
+        sym = sym_intern(name);
+        sym_sec[sym] = asm_sec;
+        sym_pos[sym] = sec_len[asm_sec];
+    }
+}
+
+///db和dq后面的数值：数字，'c'，或?
+void asm_data (char* p, int size) {
+    while (p[0] != 0) {
+        p = skip_blanks(p);
+
+        //'...' is a run of characters, one item each
+        if (p[0] == '\'')
+        {
+            p++;
+
+            while (p[0] != '\'' && p[0] != 0) {
+                put_le(asm_sec, p[0] & 255, size);
+                p++;
+            }
+
+            p++;
+        }
+        else if (p[0] == '?')
+        {
+            put_le(asm_sec, 0, size);
+
+            while (p[0] != ',' && p[0] != 0)
+                p++;
+        }
+        else
+        {
+            //All 8 bytes of a dq, even under gcc
+            read_number(p);
+            put_bytes(asm_sec, le_bytes, size);
+
+            while (p[0] != ',' && p[0] != 0)
+                p++;
+        }
+
+        p = skip_blanks(p);
+
+        if (p[0] == ',')
+            p++;
+    }
+}
+
+bool is_data (char* p) {
+    return p[0] == 'd' && (p[1] == 'b' || p[1] == 'q') && p[2] == ' ';
+}
+
+void asm_section (char* name) {
+    asm_sec = SEC_NOTE;
+
+    if (strncmp(name, "'.text'", 7) == 0)
+        asm_sec = SEC_TEXT;
+
+    else if (strncmp(name, "'.data'", 7) == 0)
+        asm_sec = SEC_DATA;
+
+    else if (strncmp(name, "'.rodata'", 9) == 0)
+        asm_sec = SEC_RODATA;
+}
+
+void asm_line (char* line) {
+    char* p = skip_blanks(line);
+    char* rest = 0;
+
+    if (p[0] == ';' || p[0] == 0)
+        return;
+
+    //name db ..., name dq ..., db ...
+    rest = asm_name(p);
+    rest = skip_blanks(rest);
+
+    if (is_data(p))
+        asm_data(p+3, p[1] == 'q' ? 8 : 1);
+
+    else if (is_data(rest))
+    {
+        asm_define(asm_word);
+        asm_data(rest+3, rest[1] == 'q' ? 8 : 1);
+    }
+    else
+    {
+        ins_no = 0;
+        ins_parse(p);
+
+        if (ins_op[0] == OP_LABEL)
+            asm_define(ins_a[0]);
+
+        else if (strcmp(ins_name[0], "section") == 0)
+            asm_section(ins_a[0]);
+
+        else if (strcmp(ins_name[0], "format") != 0 && strcmp(ins_name[0], "public") != 0
+                 && strcmp(ins_name[0], "extrn") != 0)
+            asm_ins(ins_name[0], ins_a[0], ins_b[0]);
+    }
+}
+
+///汇编一块文本，文本会被改写
+void asm_text (char* text) {
+    char* line = text;
+    char* p = text;
+
+    ins_reserve(4);
+
+    while (p[0] != 0) {
+        if (p[0] == '\n') {
+            p[0] = 0;
+            asm_line(line);
+            line = p+1;
+        }
+
+        p++;
+    }
+
+    asm_line(line);
+}
+
+//==== ELF64 ====
+
+int obj_str (int sec, char* s) {
+    int offset = sec_len[sec];
+    put_bytes(sec, s, strlen(s) + 1);
+    return offset;
+}
+
+void obj_sym (int name, int info, int sec, int value) {
+    put_le(SEC_SYMTAB, name, 4);
+    put_byte(SEC_SYMTAB, info);
+    put_byte(SEC_SYMTAB, 0);
+    put_le(SEC_SYMTAB, sec, 2);
+    put_le(SEC_SYMTAB, value, 8);
+    put_le(SEC_SYMTAB, 0, 8);
+}
+
+void obj_rela (int offset, int type, int sym, int addend) {
+    put_le(SEC_RELA, offset, 8);
+    put_le(SEC_RELA, type, 4);
+    put_le(SEC_RELA, sym, 4);
+    put_le(SEC_RELA, addend, 8);
+}
+
+void obj_shdr (int sec, int type, int flags, int link, int info, int align, int entsize) {
+    put_le(0, sec_name[sec], 4);
+    put_le(0, type, 4);
+    put_le(0, flags, 8);
+    put_le(0, 0, 8);
+    put_le(0, sec_offset[sec], 8);
+    put_le(0, sec_len[sec], 8);
+    put_le(0, link, 4);
+    put_le(0, info, 4);
+    put_le(0, align, 8);
+    put_le(0, entsize, 8);
+}
+
+///符号表：段符号，局部的函数和变量，然后是main和外部函数
+//ELF wants the locals first; sh_info of .symtab is the first global.
+int obj_symbols () {
+    int i = 0;
+    int sym = 0;
+    int n = 4;
+    int first_global = 0;
+
+    put_byte(SEC_STRTAB, 0);
+    put_zeros(SEC_SYMTAB, 24);
+
+    for (i = SEC_TEXT; i < SEC_SYMTAB; i++)
+        obj_sym(0, 3, i, 0);
+
+    for (i = 0; i < global_no; i++)
+    {
+        sym = global_syms[i];
+
+        if (sym_sec[sym] && strcmp(sym_name[sym], "main") != 0)
+        {
+            obj_sym(obj_str(SEC_STRTAB, sym_name[sym]), sym_is_fn[sym] ? 2 : 1, sym_sec[sym], sym_pos[sym]);
+            sym_index[sym] = n++;
+        }
+    }
+
+    first_global = n;
+
+    for (i = 0; i < global_no; i++)
+    {
+        sym = global_syms[i];
+
+        if (!sym_sec[sym] || strcmp(sym_name[sym], "main") == 0)
+        {
+            obj_sym(obj_str(SEC_STRTAB, sym_name[sym]), 16 + (sym_is_fn[sym] ? 2 : 0), sym_sec[sym], sym_pos[sym]);
+            sym_index[sym] = n++;
+        }
+    }
+
+    return first_global;
+}
+
+///填上.text内部的跳转，其它的变成重定位
+void obj_fixups () {
+    int i = 0;
+    int sec = 0;
+    int pos = 0;
+    int target = 0;
+
+    for (i = 0; i < fix_no; i++)
+    {
+        target = fix_target[i];
+
+        if (fix_label[i] && target < label_cap) {
+            sec = label_sec[target];
+            pos = label_pos[target];
+
+        } else if (fix_label[i]) {
+            sec = 0;
+
+        } else {
+            sec = sym_sec[target];
+            pos = sym_pos[target];
+        }
+
+        if (sec == SEC_TEXT)
+            patch32(SEC_TEXT, fix_pos[i], pos + fix_addend[i] - fix_pos[i]);
+
+        else if (sec)
+            obj_rela(fix_pos[i], R_X86_64_PC32, sec, pos + fix_addend[i]);
+
+        else if (!fix_label[i])
+            obj_rela(fix_pos[i], fix_call[i] ? R_X86_64_PLT32 : R_X86_64_PC32, sym_index[target], fix_addend[i]);
+
+        else {
+            report(0, diag_number("undefined label _%d", target));
+        }
+    }
+}
+
+void obj_write () {
+    int i = 0;
+    int first_global = obj_symbols();
+    int offset = 64;
+
+    obj_fixups();
+
+    put_byte(SEC_SHSTRTAB, 0);
+    sec_name[SEC_TEXT] = obj_str(SEC_SHSTRTAB, ".text");
+    sec_name[SEC_DATA] = obj_str(SEC_SHSTRTAB, ".data");
+    sec_name[SEC_RODATA] = obj_str(SEC_SHSTRTAB, ".rodata");
+    sec_name[SEC_SYMTAB] = obj_str(SEC_SHSTRTAB, ".symtab");
+    sec_name[SEC_STRTAB] = obj_str(SEC_SHSTRTAB, ".strtab");
+    sec_name[SEC_RELA] = obj_str(SEC_SHSTRTAB, ".rela.text");
+    sec_name[SEC_SHSTRTAB] = obj_str(SEC_SHSTRTAB, ".shstrtab");
+    sec_name[SEC_NOTE] = obj_str(SEC_SHSTRTAB, ".note.GNU-stack");
+    sec_len[SEC_NOTE] = 0;
+
+    //The sections follow the header, 8 byte aligned, then the section table
+    for (i = 1; i < SECS; i++)
+    {
+        sec_offset[i] = (offset + 7) & -8;
+        offset = sec_offset[i] + sec_len[i];
+    }
+
+    offset = (offset + 7) & -8;
+
+    //ELF64, little endian, System V
+    put_byte(0, 127);
+    put_bytes(0, "ELF", 3);
+    put_byte(0, 2);
+    put_byte(0, 1);
+    put_byte(0, 1);
+    put_zeros(0, 9);
+    put_le(0, 1, 2);
+    put_le(0, 62, 2);
+    put_le(0, 1, 4);
+    put_le(0, 0, 8);
+    put_le(0, 0, 8);
+    put_le(0, offset, 8);
+    put_le(0, 0, 4);
+    put_le(0, 64, 2);
+    put_le(0, 0, 2);
+    put_le(0, 0, 2);
+    put_le(0, 64, 2);
+    put_le(0, SECS, 2);
+    put_le(0, SEC_SHSTRTAB, 2);
+
+    for (i = 1; i < SECS; i++)
+    {
+        put_zeros(0, sec_offset[i] - sec_len[0]);
+        put_bytes(0, sec_buf[i], sec_len[i]);
+    }
+
+    put_zeros(0, offset - sec_len[0]);
+    put_zeros(0, 64);
+
+    //SHT_PROGBITS 1, SHT_SYMTAB 2, SHT_STRTAB 3, SHT_RELA 4
+    //SHF_WRITE 1, SHF_ALLOC 2, SHF_EXECINSTR 4, SHF_INFO_LINK 64
+    obj_shdr(SEC_TEXT, 1, 6, 0, 0, 16, 0);
+    obj_shdr(SEC_DATA, 1, 3, 0, 0, 8, 0);
+    obj_shdr(SEC_RODATA, 1, 2, 0, 0, 1, 0);
+    obj_shdr(SEC_SYMTAB, 2, 0, SEC_STRTAB, first_global, 8, 24);
+    obj_shdr(SEC_STRTAB, 3, 0, 0, 0, 1, 0);
+    obj_shdr(SEC_RELA, 4, 64, SEC_SYMTAB, SEC_TEXT, 8, 24);
+    obj_shdr(SEC_SHSTRTAB, 3, 0, 0, 0, 1, 0);
+    obj_shdr(SEC_NOTE, 1, 0, 0, 0, 1, 0);
+
+    out_write(sec_buf[0], sec_len[0]);
+}
+
+//==== Running in memory ====
+
+///外部函数跳板：jmp qword [rip+0]，后面是dlsym找到的地址
+//The mapping can be anywhere, so calls into libc can't be rel32 direct.
+int JIT_STUB = 16;
+
+///地址按字节拷进跳板
+char** jit_addr;
+
+///入口地址当作函数来调用
+int* jit_fn (int* code) {
+    return code;
+}
+
+//gcc needs a typed pointer to call through; mini-c skips this line and
+//calls the function above instead.
+#define jit_fn(code) ((int (*) (int, char**)) (code))
+
+///给引用了的外部函数分配跳板，sym_index记住跳板的位置
+void jit_stubs () {
+    int i = 0;
+    int target = 0;
+
+    for (i = 0; i < fix_no; i++)
+    {
+        target = fix_target[i];
+
+        if (!fix_label[i] && !sym_sec[target] && !sym_index[target])
+        {
+            sym_index[target] = sec_len[SEC_TEXT];
+            put_byte(SEC_TEXT, 255);
+            put_byte(SEC_TEXT, 37);
+            put_zeros(SEC_TEXT, JIT_STUB - 2);
+        }
+    }
+}
+
+///段在映射中的位置：.text单独占整页，之后是.data和.rodata
+void jit_layout () {
+    sec_offset[SEC_TEXT] = 0;
+    sec_offset[SEC_DATA] = (sec_len[SEC_TEXT] + 4095) & -4096;
+    sec_offset[SEC_RODATA] = (sec_offset[SEC_DATA] + sec_len[SEC_DATA] + 7) & -8;
+}
+
+///和obj_fixups一样，只是所有地址都已知
+void jit_fixups () {
+    int i = 0;
+    int sec = 0;
+    int pos = 0;
+    int target = 0;
+
+    for (i = 0; i < fix_no; i++)
+    {
+        target = fix_target[i];
+
+        if (fix_label[i] && target < label_cap) {
+            sec = label_sec[target];
+            pos = label_pos[target];
+
+        } else if (fix_label[i]) {
+            sec = 0;
+
+        } else if (sym_sec[target]) {
+            sec = sym_sec[target];
+            pos = sym_pos[target];
+
+        } else {
+            sec = SEC_TEXT;
+            pos = sym_index[target];
+        }
+
+        if (sec)
+            patch32(SEC_TEXT, fix_pos[i], sec_offset[sec] + pos + fix_addend[i] - fix_pos[i]);
+
+        else {
+            report(0, diag_number("undefined label _%d", target));
+        }
+    }
+}
+
+#ifdef _WIN32
+///Windows上没有--run
+int jit_run (int argc, char** argv) {
+    puts("error: --run is not supported on Windows");
+    return 1;
+}
+#else
+///--run：把三个段放进可执行的内存，找到库函数，调用main
+int jit_run (int argc, char** argv) {
+    int i = 0;
+    int sym = 0;
+    int size = 0;
+    char* base = 0;
+
+    sym = sym_lookup("main");
+
+    if (sym < 0 || !sym_sec[sym] || !sym_is_fn[sym])
+    {
+        puts("error: no main function");
+        return 1;
+    }
+
+    jit_stubs();
+    jit_layout();
+    jit_fixups();
+
+    if (errors)
+        return 1;
+
+    size = sec_offset[SEC_RODATA] + sec_len[SEC_RODATA];
+
+    //PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS
+    base = mmap(0, size, 3, 34, -1, 0);
+
+    //MAP_FAILED is -1, and a mapping is page aligned, so the low word tells
+    jit_addr = le_buf;
+    jit_addr[0] = base;
+
+    if (base == 0 || le_word[0] == -1)
+    {
+        puts("error: cannot map memory");
+        return 1;
+    }
+
+    for (i = SEC_TEXT; i < SEC_SYMTAB; i++)
+        memcpy(base + sec_offset[i], sec_buf[i], sec_len[i]);
+
+    for (i = 0; i < global_no; i++)
+    {
+        sym = global_syms[i];
+
+        if (!sym_sec[sym] && sym_index[sym])
+        {
+            //RTLD_DEFAULT is 0 in glibc
+            jit_addr[0] = dlsym(0, sym_name[sym]);
+            memcpy(base + sym_index[sym] + 6, le_buf, PTR_SIZE);
+
+            if (jit_addr[0] == 0)
+            {
+                report(0, diag_format("undefined symbol %s", sym_name[sym], ""));
+            }
+        }
+    }
+
+    //PROT_READ|PROT_EXEC for the text pages
+    if (errors || (sec_offset[SEC_DATA] && mprotect(base, sec_offset[SEC_DATA], 5) != 0))
+        return 1;
+
+    sym = sym_lookup("main");
+    return jit_fn(base + sym_pos[sym])(argc, argv);
+}
+#endif
+
+//==== Function cache ====
+
+///-fcache=DIR：每个函数生成的代码按内容存在DIR里，没有变的函数直接拿来用
+//An entry is keyed on the options and the function's token stream, from
+//its return type to the closing brace. It also lists the global symbols
+//its code names, as they were declared then, and is only used while they
+//are still declared the same way. Labels in an entry count from the
+//function's first one and the strings it uses are kept as bytes, so the
+//code can be spliced in wherever the function comes this time.
+char* cache_dir = 0;
+
+///当前模块声明的token流，用空格隔开
+char* cache_key;
+int cache_key_len = 0;
+int cache_key_cap = 0;
+
+///条目文件：写的时候在这里拼好，读的时候整个读进来
+char* cache_buf;
+int cache_len = 0;
+int cache_cap = 0;
+int cache_at = 0;
+FILE* cache_file;
+char* cache_path;
+
+///条目头：总长、键长、标号数、字符串数、符号数、代码长，各10位
+int CACHE_HEAD = 66;
+
+///条目用到的字符串：写的时候是字符串编号，读的时候是这次的标号
+int* cache_strs;
+int cache_strs_cap = 0;
+
+///标号是哪个字符串的（编号+1），不是字符串的为0
+int* cache_label_str;
+int cache_label_cap = 0;
+int cache_strs_seen = 0;
+
+///符号在这个条目里已经列出了
+int* cache_mark;
+int cache_stamp = 0;
+
+int cache_hits = 0;
+int cache_misses = 0;
+bool cache_warned = false;
+
+void cache_init () {
+    cache_recording = false;
+    cache_strs_seen = 0;
+    cache_hits = 0;
+    cache_misses = 0;
+    cache_mark = renew(cache_mark, sym_cap, WORD_SIZE);
+
+    free(cache_label_str);
+    cache_label_str = 0;
+    cache_label_cap = 0;
+
+    if (cache_dir)
+    {
+        free(cache_path);
+        cache_path = malloc(strlen(cache_dir) + 16);
+    }
+}
+
+void cache_grow (int len, int cap) {
+    cache_mark = grow(cache_mark, len, cap, WORD_SIZE);
+}
+
+void cache_key_put (char* data, int n) {
+    if (cache_key_len + n > cache_key_cap)
+    {
+        cache_key_cap = cache_key_cap + cache_key_cap + n + 4096;
+        cache_key = grow(cache_key, cache_key_len, cache_key_cap, 1);
+    }
+
+    memcpy(cache_key + cache_key_len, data, n);
+    cache_key_len = cache_key_len + n;
+}
+
+///一个模块声明开始了：当前token是它的第一个
+void cache_begin () {
+    cache_key_len = 0;
+    cache_key_put("mini-c 1 ", 9);
+    cache_key_put(abi == ABI_SYSV ? "sysv " : "ms   ", 5);
+    cache_key_put(ast_mode ? "-O1 " : "-O0 ", 4);
+    cache_key_put(peephole ? "p " : "- ", 2);
+    cache_key_put(obj_mode ? "c " : "- ", 2);
+    cache_key_put(instrument ? "i\n" : "-\n", 2);
+    cache_token();
+    cache_recording = true;
+}
+
+///next()每读一个token调用一次
+void cache_token () {
+    cache_key_put(buffer, buflength);
+    cache_key_put(" ", 1);
+}
+
+void cache_reserve (int n) {
+    if (cache_len + n + 1 > cache_cap)
+    {
+        cache_cap = cache_cap + cache_cap + n + 4096;
+        cache_buf = grow(cache_buf, cache_len, cache_cap, 1);
+    }
+}
+
+void cache_put (char* data, int n) {
+    cache_reserve(n);
+    memcpy(cache_buf + cache_len, data, n);
+    cache_len = cache_len + n;
+}
+
+void cache_put_int (int n, char end) {
+    cache_reserve(12);
+    cache_len = put_digits(cache_buf + cache_len, n, 1) - cache_buf;
+    cache_buf[cache_len++] = end;
+}
+
+///读一个十进制数和它后面的分隔符
+int cache_int () {
+    int n = 0;
+
+    while (char_class[cache_buf[cache_at] & 255] == CC_DIGIT) {
+        n = n*10 + (cache_buf[cache_at] & 255) - '0';
+        cache_at++;
+    }
+
+    if (cache_at < cache_len)
+        cache_at++;
+
+    return n;
+}
+
+///条目文件名：键的两个24位哈希
+char* cache_name () {
+    int h1 = 0;
+    int h2 = 0;
+    int i = 0;
+
+    for (i = 0; i < cache_key_len; i++)
+    {
+        h1 = (h1*31 + (cache_key[i] & 255)) & 16777215;
+        h2 = (h2*101 + (cache_key[i] & 255)) & 16777215;
+    }
+
+    sprintf(cache_path, "%s/%06x%06x", cache_dir, h1, h2);
+    return cache_path;
+}
+
+///p[i]是不是一个标号_nnnnnnnn的开头
+bool cache_is_label (char* p, int i, int from) {
+    int k = 0;
+
+    if (p[i] != '_' || (i > from && char_class[p[i-1] & 255] >= CC_ALPHA))
+        return false;
+
+    for (k = 1; k < 9; k++)
+    {
+        if (char_class[p[i+k] & 255] != CC_DIGIT)
+            return false;
+    }
+
+    return char_class[p[i+9] & 255] < CC_ALPHA;
+}
+
+int cache_label (char* p) {
+    int n = 0;
+    int k = 0;
+
+    for (k = 1; k < 9; k++)
+        n = n*10 + (p[k] & 255) - '0';
+
+    return n;
+}
+
+///条目里的字符串编号，第一次用到时加进去
+int cache_str_index (int str, int strs) {
+    int i = 0;
+
+    for (i = 0; i < strs; i++)
+    {
+        if (cache_strs[i] == str)
+            return i;
+    }
+
+    if (strs == cache_strs_cap)
+    {
+        cache_strs = grow(cache_strs, strs, cache_strs_cap + cache_strs_cap + 16, WORD_SIZE);
+        cache_strs_cap = cache_strs_cap + cache_strs_cap + 16;
+    }
+
+    cache_strs[strs] = str;
+    return strs;
+}
+
+///没有错误地编译完一个函数：输出缓冲区从start开始是它的代码，标号从base开始
+void cache_store (int start, int base) {
+    int labels = label_no - base;
+    int refs = 0;
+    int strs = 0;
+    int text = 0;
+    int str = 0;
+    int sym = 0;
+    int n = 0;
+    int i = 0;
+    int j = 0;
+    char c = 0;
+
+    //Which labels are strings, for the strings interned since last time
+    if (label_no > cache_label_cap)
+    {
+        cache_label_str = grow(cache_label_str, cache_label_cap, label_no + label_no, WORD_SIZE);
+        cache_label_cap = label_no + label_no;
+    }
+
+    for (i = cache_strs_seen; i < str_no; i++)
+        cache_label_str[str_label[i]] = i+1;
+
+    cache_strs_seen = str_no;
+
+    cache_len = 0;
+    cache_reserve(CACHE_HEAD);
+    cache_len = CACHE_HEAD;
+    cache_put(cache_key, cache_key_len);
+    cache_put("\n", 1);
+
+    //The global symbols the code names, once each
+    cache_stamp++;
+    i = start;
+
+    while (i < out_len) {
+        if (char_class[out_buf[i] & 255] == CC_DIGIT)
+        {
+            while (char_class[out_buf[i] & 255] >= CC_ALPHA)
+                i++;
+        }
+        else if (cache_is_label(out_buf, i, start))
+            i = i + 9;
+
+        else if (char_class[out_buf[i] & 255] == CC_ALPHA)
+        {
+            j = i;
+
+            while (char_class[out_buf[j] & 255] >= CC_ALPHA)
+                j++;
+
+            c = out_buf[j];
+            out_buf[j] = 0;
+            sym = sym_lookup(out_buf + i);
+
+            if (sym >= 0 && sym_global[sym] && cache_mark[sym] != cache_stamp)
+            {
+                cache_mark[sym] = cache_stamp;
+                cache_put(out_buf + i, j - i);
+                cache_put(" ", 1);
+                cache_put_int(sym_is_fn[sym], ' ');
+                cache_put_int(sym_is_extern[sym], ' ');
+                cache_put_int(sym_global_type[sym], '\n');
+                refs++;
+            }
+
+            out_buf[j] = c;
+            i = j;
+        }
+        else
+            i++;
+    }
+
+    //The code, with its labels counted from base and its strings after those
+    text = cache_len;
+    cache_put(out_buf + start, out_len - start);
+
+    for (i = text; i < cache_len; i++)
+    {
+        if (cache_is_label(cache_buf, i, text))
+        {
+            n = cache_label(cache_buf + i);
+
+            if (cache_label_str[n])
+            {
+                str = cache_label_str[n] - 1;
+                n = labels + cache_str_index(str, strs);
+
+                if (n == labels + strs)
+                    strs++;
+            }
+            else
+                n = n - base;
+
+            //Not one of this function's, so it can't be moved
+            if (n < 0)
+                return;
+
+            put_digits(cache_buf + i + 1, n, 8);
+            i = i + 8;
+        }
+    }
+
+    text = cache_len - text;
+
+    //A string first seen in this function keeps its place among its labels
+    for (i = 0; i < strs; i++)
+    {
+        str = cache_strs[i];
+        n = str_label[str] - base;
+        cache_put_int(n < 0 ? labels : n, ' ');
+        cache_put_int(str_len[str], ' ');
+        cache_put(str_pool + str_start[str], str_len[str]);
+        cache_put("\n", 1);
+    }
+
+    put_digits(cache_buf, cache_len, 10);
+    put_digits(cache_buf + 11, cache_key_len, 10);
+    put_digits(cache_buf + 22, labels, 10);
+    put_digits(cache_buf + 33, strs, 10);
+    put_digits(cache_buf + 44, refs, 10);
+    put_digits(cache_buf + 55, text, 10);
+
+    for (i = 10; i < CACHE_HEAD; i = i + 11)
+        cache_buf[i] = ' ';
+
+    cache_buf[CACHE_HEAD - 1] = '\n';
+
+    cache_file = fopen(cache_name(), "wb");
+
+    if (!cache_file)
+    {
+        if (!cache_warned)
+            printf("%s: warning: cannot write to the cache\n", cache_dir);
+
+        cache_warned = true;
+        return;
+    }
+
+    fwrite(cache_buf, 1, cache_len, cache_file);
+    fclose(cache_file);
+}
+
+///读入条目文件，检查它是完整的
+bool cache_read (char* path) {
+    int n = 0;
+
+    cache_file = fopen(path, "rb");
+
+    if (!cache_file)
+        return false;
+
+    //SEEK_END, SEEK_SET
+    fseek(cache_file, 0, 2);
+    n = ftell(cache_file);
+    fseek(cache_file, 0, 0);
+
+    cache_len = 0;
+    cache_reserve(n);
+    cache_len = fread(cache_buf, 1, n, cache_file);
+    cache_buf[cache_len] = 0;
+    fclose(cache_file);
+
+    cache_at = 0;
+    return cache_len > CACHE_HEAD && cache_int() == cache_len;
+}
+
+///条目找到了而且还能用：把代码接到输出里
+bool cache_load () {
+    int labels = 0;
+    int strs = 0;
+    int refs = 0;
+    int text = 0;
+    int text_at = 0;
+    int base = 0;
+    int end = 0;
+    int label = 0;
+    int start = 0;
+    int sym = 0;
+    int n = 0;
+    int i = 0;
+    char* name = 0;
+
+    if (!cache_read(cache_name()))
+        return false;
+
+    //The same declaration, token for token
+    if (cache_int() != cache_key_len)
+        return false;
+
+    labels = cache_int();
+    strs = cache_int();
+    refs = cache_int();
+    text = cache_int();
+
+    for (i = 0; i < cache_key_len; i++)
+    {
+        if (cache_buf[CACHE_HEAD + i] != cache_key[i])
+            return false;
+    }
+
+    cache_at = CACHE_HEAD + cache_key_len + 1;
+
+    //The symbols it names still mean the same
+    for (i = 0; i < refs; i++)
+    {
+        name = cache_buf + cache_at;
+
+        while (cache_at < cache_len && cache_buf[cache_at] != ' ')
+            cache_at++;
+
+        cache_buf[cache_at] = 0;
+        cache_at++;
+        sym = sym_lookup(name);
+
+        if (sym < 0 || !sym_global[sym])
+            return false;
+
+        if (cache_int() != sym_is_fn[sym] || cache_int() != sym_is_extern[sym] || cache_int() != sym_global_type[sym])
+            return false;
+    }
+
+    text_at = cache_at;
+    cache_at = cache_at + text;
+
+    if (cache_at > cache_len)
+        return false;
+
+    //Its labels come next. A string that is new here takes the label it
+    //had among them, so the numbering comes out as if it were compiled.
+    base = label_no;
+    end = base + labels;
+
+    if (strs > cache_strs_cap)
+    {
+        cache_strs = grow(cache_strs, 0, strs, WORD_SIZE);
+        cache_strs_cap = strs;
+    }
+
+    for (i = 0; i < strs; i++)
+    {
+        label = cache_int();
+        n = cache_int();
+
+        if (cache_at + n > cache_len)
+        {
+            label_no = end;
+            return false;
+        }
+
+        label_no = label < labels ? base + label : end;
+        start = str_pool_len;
+        str_reserve(n);
+        memcpy(str_pool + start, cache_buf + cache_at, n);
+        str_pool_len = start + n;
+        cache_strs[i] = str_intern(start);
+        cache_at = cache_at + n + 1;
+
+        if (label >= labels)
+            end = label_no;
+    }
+
+    label_no = end;
+
+    out_reserve(text);
+    memcpy(out_buf + out_len, cache_buf + text_at, text);
+
+    for (i = out_len; i < out_len + text; i++)
+    {
+        if (cache_is_label(out_buf, i, out_len))
+        {
+            n = cache_label(out_buf + i);
+
+            if (n < labels)
+                n = base + n;
+            else
+                n = cache_strs[n - labels];
+
+            put_digits(out_buf + i + 1, n, 8);
+            i = i + 8;
+        }
+    }
+
+    out_len = out_len + text;
+    return true;
+}
+
+///读到函数体结束的'}'，token都记进键里。停在'}'上，没有的话返回false
+bool cache_scan () {
+    int depth = 0;
+
+    while (token != TOKEN_EOF) {
+        if (see(TOKEN_LBRACE))
+            depth++;
+        else if (see(TOKEN_RBRACE))
+            depth--;
+
+        if (depth == 0)
+            return true;
+
+        next();
+    }
+
+    return false;
+}
+
+///函数体之前，当前token是'{'：缓存里有的话用缓存的代码，跳过函数体
+bool cache_lookup () {
+    char* at_cur = cur;
+    char* at_buffer = buffer;
+    char at_saved = saved_ch;
+    int at_length = buflength;
+    int at_token = token;
+    int at_line = curln;
+    bool found = cache_scan() && cache_load();
+
+    cache_recording = false;
+
+    if (found)
+    {
+        cache_hits++;
+        next();
+        return true;
+    }
+
+    //Back to the '{' to compile it
+    cur[0] = saved_ch;
+    cur = at_cur;
+    saved_ch = at_saved;
+    buffer = at_buffer;
+    buflength = at_length;
+    token = at_token;
+    curln = at_line;
+    cur[0] = 0;
+
+    cache_misses++;
+    return false;
+}
+
+//==== One-pass parser and code generator ====
+
+bool lvalue;
+
+void needs_lvalue (char* msg) {
+    if (!lvalue)
+        error(msg);
+
+    lvalue = false;
+}
+
+int expr (int level);
+
+int char_preprocess(char* buf)
+{
+    int i = 0;
+    int n = 0;
+
+    ///特殊字符处理
+    //if(strncmp(buf+1,"n",1)==0)
+    if(buf[1]=='n')
+    {
+        return '\n';
+    }
+    else if(buf[1]=='r') //if(strncmp(buf+1,"r",1)==0)
+    {
+        return '\r';
+    }
+    else if(buf[1]=='t')//if(strncmp(buf+1,"t",1)==0)
+    {
+        return '\t';
+    }
+    else if(buf[1]=='0')// if(strncmp(buf+1,"0",1)==0)
+    {
+        return '\0';
+    }
+    else if(buf[1]=='\\') //if(strncmp(buf+1,"\\",1)==0)
+    {
+        return '\\';
+    }
+    else if(buf[1]=='\'')//if(strncmp(buf+1,"'",1)==0)
+    {
+        return '\'';
+    }
+    else if(buf[1]=='"')
+    {
+        return '"';
+    }
+    else if(buf[1]=='x')
+    {
+        //At most two digits, as escape_len() counts them
+        n = 0;
+
+        for (i = 2; i < escape_len(buf); i++)
+            n = (n*16) + hex_digit(buf+i);
+
+        return n;
+    }
+
+    error("unknown escape sequence in %s\n");
+    return 12346;
+
+}
+
+/// 表达式的代码生成，通过将结果放到eax，然后放入堆栈实现
+//The code generator for expressions works by placing the results
+//in eax and backing them up to the stack.
+
+/// 左值和赋值
+/// 表达式返回左值，可以向前看一个赋值算符。如果找到，就把地址放入结果。否则变为右值。
+///
+/// 全局左值标记跟踪上一个算符是否是左值。赋值算符检查并复位标记。
+//Regarding lvalues and assignment:
+
+//An expression which can return an lvalue looks head for an
+//assignment operator. If it finds one, then it pushes the
+//address of its result. Otherwise, it dereferences it.
+
+//The global lvalue flag tracks whether the last operand was an
+//lvalue; assignment operators check and reset it.
+
+///
+/// \brief factor
+///
+///一.lea指令:
+///对于寄存器来说:第二个操作数是寄存器必须要加[],不然报错,这里lea就是取[寄存器]的值,如:
+/// mov eax,2
+/// lea ebx,[eax];执行后ebx=2
+/// mov ebx,eax;等同于上句
+/// lea ebx,eax;编译器报错: error A2070: invalid instruction operands
+/// 对于变量来说加不加[]都是一样的效果,都是取变量的地址,相当于指针
+/// 如:
+/// num dword 2
+/// lea ebx,num
+/// lea eax,[num]; eax为num的地址,如eax=4206598,随程序不同不同,这时ebx==eax
+///二.mov指令:
+/// 对于变量来说
+/// num dword 2
+/// mov eax,2
+/// mov ebx,num
+/// mov ecx,[num];执行完ebx==ecx==2
+/// 对寄存器
+/// mov ebx,eax;ebx==2
+/// mov ecx,[eax];可能会报错,因为这里翻译成汇编是mov ecx,DS:[eax]
+/// 总的说来加不加中括号[]的区别就是:
+/// lea对变量没有影响是取地址,对寄存器来说加[]时取值,第二操作数不加[]非法
+/// mov对变量来说没有影响是取值,对寄存器来说是加[]时取地址,第二操作数不加[]是取值
+
+int factor ()
+{
+    int node = 0;
+    int value = 0;
+    lvalue = false;
+    typ=TYPE_UNKNOWN;
+    if (see(TOKEN_KW_TRUE) || see(TOKEN_KW_FALSE))
+    {
+        if (ast_mode)
+            node = new_node(NODE_NUM, 0, 0, see(TOKEN_KW_TRUE));
+        else
+            emit_imm("mov", "rax", see(TOKEN_KW_TRUE) ? 1 : 0);
+
+        next();
+    }
+    else if (token == TOKEN_IDENT)
+    {
+        int sym = sym_lookup(buffer);
+        bool local = is_local(sym);
+        bool global = is_global(sym);
+
+        require(global || local, "no symbol '%s' declared\n");
+        next();
+
+        if (see(TOKEN_ASSIGN) || see(TOKEN_INC) || see(TOKEN_DEC))
+        {
+            ///如果有 a=121; 或 a++; 或a--;则 a要保留左值
+            lvalue = true;
+        }
+
+        ///FIXME: 此处应该是先局部变量，再全局变量???
+        if (local && sym_is_array[sym])
+        {
+            require(!lvalue, "cannot assign to an array\n");
+            typ = sym_local_type[sym];
+
+            //a[i] is read straight from the frame by object()
+            if (ast_mode)
+                node = new_node(NODE_ARRAY, 0, 0, sym_offset[sym]);
+            else if (see(TOKEN_LBRACKET))
+                direct_array = sym;
+            else
+                emit_load("lea", "rax", "rbp", sym_offset[sym]);
+        }
+        else if (local)
+        {
+            /// 局部变量，通过栈指针获取
+            typ=sym_local_type[sym];
+
+            if (ast_mode)
+                node = new_node(NODE_LOCAL, 0, sym, sym_offset[sym]);
+            else
+                emit_load(lvalue ? "lea" : "mov", "rax", "rbp", sym_offset[sym]);
+        }
+        else  if (global)
+        {
+            ///全局变量，通过变量名读取
+            typ = sym_global_type[sym];
+
+            if (ast_mode)
+                node = new_node(NODE_GLOBAL, 0, 0, sym);
+            else if (sym_is_fn[sym] && see(TOKEN_LPAREN))
+                direct_callee = sym;
+            else
+                emit_sym(sym_is_fn[sym] || lvalue ? "lea" : "mov", "rax", sym_name[sym]);
+        }
+    }
+    else if (token == TOKEN_INT)
+    {
+        //A literal too wide for node_val is kept as its text, as -O0 does
+        if (ast_mode)
+        {
+            value = read_number(buffer);
+            node = number_fits() ? new_node(NODE_NUM, 0, 0, value) : new_wide(buffer);
+        }
+        else
+            emit_ins("mov", "rax", buffer);
+
+        next();
+    }
+    else if(token==TOKEN_CHAR)
+    {
+        int char_out = 0;
+        if(buffer[1]!='\\')
+        {
+            //不是特殊字符，直接返回
+            char_out = buffer[1] & 255;
+
+            if (!ast_mode)
+                emit_ins("mov", "rax", buffer);
+        }
+        else
+        {
+            char_out = char_preprocess(buffer+1);
+
+            if (!ast_mode)
+                emit_imm("mov", "rax", char_out);
+        }
+
+        if (ast_mode)
+            node = new_node(NODE_NUM, 0, 0, char_out);
+
+        next();
+    }
+    else if (token == TOKEN_STR)
+    {
+        ///字符串不在此处生成，而是放进常量池，最后在.rodata中生成
+        ///相邻的字符串接在一起
+        int start = str_pool_len;
+        int str = 0;
+
+        while (token == TOKEN_STR)
+        {
+            str_append(buffer);
+            next();
+        }
+
+        str = str_intern(start);
+
+        if (ast_mode)
+            node = new_node(NODE_STR, 0, 0, str);
+        else
+            emit_label_addr("rax", str);
+    }
+    else if (try_match(TOKEN_LPAREN))
+    {
+        node = expr(0);
+        must_match(TOKEN_RPAREN);
+    }
+    else
+    {
+        error("expected an expression, found '%s'\n");
+    }
+
+    return node;
+}
+
+int object () {
+    int node = 0;
+    int arg = 0;
+    int last_arg = 0;
+
+    direct_callee = -1;
+    direct_array = -1;
+    node = factor();
+
+    while (true) {
+        if (try_match(TOKEN_LPAREN))
+        {
+            int callee = direct_callee;///此处记录，避免在解析参数时被覆盖
+            direct_callee = -1;
+
+            ///函数指针
+            if (!ast_mode && callee < 0)
+                emit_ins("push", "rax", 0);
+
+            if (ast_mode)
+                node = new_node(NODE_CALL, node, 0, 0);
+
+            /// 此处是函数调用:
+            /// 4个参数，从左到右，依次放入  - RCX、RDX、R8 和 R9
+            /// func1(a,b,c);
+
+            int arg_no = 0;
+
+            if (ast_mode && waiting_for(TOKEN_RPAREN))
+            {
+                do {
+                    arg = expr(0);
+
+                    if (arg_no == 0)
+                        node_b[node] = arg;
+                    else
+                        node_next[last_arg] = arg;
+
+                    last_arg = arg;
+                    arg_no++;
+                } while (try_match(TOKEN_COMMA));
+
+                node_c[node] = arg_no;
+            }
+            else if (waiting_for(TOKEN_RPAREN))
+            {
+                ///参数从左到右求值并压栈，emit_call再整理
+                do {
+                    expr(0);
+                    emit_ins("push", "rax", 0);
+                    arg_no++;
+                } while (try_match(TOKEN_COMMA));
+            }
+
+            must_match(TOKEN_RPAREN);
+
+            if (!ast_mode)
+            {
+                fn_calls = true;
+                emit_call(callee, arg_no);
+            }
+
+        }
+        else if (try_match(TOKEN_LBRACKET))
+        {
+            int lv_typ;
+            int index = 0;
+            int scale = WORD_SIZE;
+            int array = direct_array;
+            direct_array = -1;
+            lv_typ = typ;//先记录下类型，避免后期被覆盖
+            /// 中括号：
+            /// 1 push eax; 先将左值eax放入栈
+            /// 2 val->eax求中括号内的表达式的值（默认会放入eax中）
+            /// 3 pop ebx; lea/mov eax, [eax*d+ebx]
+            if (!ast_mode && array < 0)
+                emit_ins("push", "rax", 0);
+
+            index = expr(0);
+            must_match(TOKEN_RBRACKET);
+
+            if (see(TOKEN_ASSIGN) || see(TOKEN_INC) || see(TOKEN_DEC))
+                lvalue = true;
+
+
+            if (lv_typ==TYPE_CHAR_PTR)
+            {
+                scale = 1;
+                typ = TYPE_CHAR;
+            }
+            else
+            {
+                if (lv_typ==TYPE_CHAR_PTR_PTR)
+                    typ=TYPE_CHAR_PTR;
+                else
+                    typ=TYPE_INT;
+            }
+
+            if (ast_mode)
+                node = new_node(NODE_INDEX, node, index, scale);
+            else if (array >= 0)
+                emit_scaled_local(lvalue ? "lea" : "mov", "rax", scale, sym_offset[array]);
+            else
+            {
+                emit_ins("pop", "r11", 0);
+                emit_scaled(lvalue ? "lea" : "mov", "rax", scale, "r11");
+            }
+
+        }
+        else
+        {
+            return node;
+        }
     }
+}
 
-    printf("error unknown char:%s\n", buffer);
-    error("err: %s\n");
-    return 12346;
+int unary () {
+    int node = 0;
+
+    if (try_match(TOKEN_BANG))
+    {
+        /// last in first out.
+        //Recurse to allow chains of unary operations, LIFO order
+        node = unary();
 
+        if (ast_mode)
+            node = fold(new_node(NODE_NOT, node, 0, 0));
+        else
+        {
+            emit_imm("cmp", "rax", 0);
+            emit_imm("mov", "rax", 0);
+            emit_ins("sete", "al", 0);
+        }
+
+    }
+    else if (try_match(TOKEN_MINUS))
+    {
+        node = unary();
+
+        if (ast_mode)
+            node = fold(new_node(NODE_NEG, node, 0, 0));
+        else
+            emit_ins("neg", "rax", 0);
+
+    } else
+    {
+        //This function call compiles itself
+        node = object();
+
+        if (see(TOKEN_INC) || see(TOKEN_DEC))
+        {
+            if (ast_mode)
+                node = new_node(see(TOKEN_INC) ? NODE_POST_INC : NODE_POST_DEC, node, 0, 0);
+            else
+                emit_post_step(see(TOKEN_INC));
+
+            needs_lvalue("assignment operator '%s' requires a modifiable object\n");
+            next();
+        }
+    }
+
+    return node;
 }
 
-/// 表达式的代码生成，通过将结果放到eax，然后放入堆栈实现
-//The code generator for expressions works by placing the results
-//in eax and backing them up to the stack.
+///二元算符的优先级和指令，按token种类索引
+//Levels and instructions of the binary operators, indexed by token kind
+//binop_negated is the condition code of the opposite comparison
+int* binop_level;
+char** binop_instr;
+char** binop_negated;
+
+void binop_def (int kind, int level, char* instr, char* negated) {
+    binop_level[kind] = level;
+    binop_instr[kind] = instr;
+    binop_negated[kind] = negated;
+}
 
-/// 左值和赋值
-/// 表达式返回左值，可以向前看一个赋值算符。如果找到，就把地址放入结果。否则变为右值。
-///
-/// 全局左值标记跟踪上一个算符是否是左值。赋值算符检查并复位标记。
-//Regarding lvalues and assignment:
+void binop_init () {
+    binop_level = renew(binop_level, TOKEN_KINDS, WORD_SIZE);
+    binop_instr = renew(binop_instr, TOKEN_KINDS, PTR_SIZE);
+    binop_negated = renew(binop_negated, TOKEN_KINDS, PTR_SIZE);
+
+    binop_def(TOKEN_PLUS, 4, "add", 0);
+    binop_def(TOKEN_MINUS, 4, "sub", 0);
+    binop_def(TOKEN_STAR, 4, "imul", 0);
+    binop_def(TOKEN_AMP, 4, "and", 0);
+
+    binop_def(TOKEN_EQ, 3, "e", "ne");
+    binop_def(TOKEN_NE, 3, "ne", "e");
+    binop_def(TOKEN_LESS, 3, "l", "ge");
+    binop_def(TOKEN_GE, 3, "ge", "l");
+    binop_def(TOKEN_GREATER, 3, "g", "le");
+}
 
-//An expression which can return an lvalue looks head for an
-//assignment operator. If it finds one, then it pushes the
-//address of its result. Otherwise, it dereferences it.
+///从栈中取出左操作数，和rax中的右操作数运算
+//The left operand is on the stack, the right one in rax
+void emit_binary (int op, int left_typ, int right_typ) {
+    if (binop_level[op] == 4)
+    {/// +-*& 数据
+        emit_ins("mov", "r11", "rax");
+        emit_ins("pop", "rax", 0);
+        emit_ins(binop_instr[op], "rax", "r11");
+    }
 
-//The global lvalue flag tracks whether the last operand was an
-//lvalue; assignment operators check and reset it.
+    else
+    {/// == != < > >= 判断
+        emit_ins("pop", "r11", 0);
+
+        if(left_typ==TYPE_CHAR)
+        {
+            emit_ins("and", "r11", "0xff");
+        }
+        if(right_typ==TYPE_CHAR)
+        {
+            emit_ins("and", "rax", "0xff");
+        }
+        emit_ins("cmp", "r11", "rax");
+        emit_imm("mov", "rax", 0);
+        emit_ins(ins_join("set", binop_instr[op]), "al", 0);
+    }
+}
+
+///赋值：地址在栈中，值在rax
+void emit_store (bool byte) {
+    emit_ins("pop", "r11", 0);
+    if(byte)
+    {
+        emit_ins("mov", "byte [r11]", "al");//dword ptr
+    }
+    else
+    {
+        emit_ins("mov", "[r11]", "rax");//dword ptr
+    }
+}
+
+int branch (bool isexpr, int cond);
+
+int expr (int level)
+{
+    ///通过level解决优先级问题
+    ///
+    ///
+
+    int node = 0;
+    int right = 0;
+    int op = 0;
+
+    if (level == 5)
+    {
+        // 如果5级了。可以 处理单目运算符，并返回
+        return unary();
+    }
+
+    int left_typ=TYPE_INT;
+    int right_typ = TYPE_INT;
+
+    ///否则，先去处理更高优先级的表达式
+    node = expr(level+1);
+
+    left_typ = typ;
+
+    while (level > 2 && binop_level[token] == level)
+    {
+        ///优先级4: +-*&
+        /// 优先级3: == != < >=
+        if (!ast_mode)
+            emit_ins("push", "rax", 0);
+
+        op = token;
+        next();
+        right = expr(level+1);
+        right_typ = typ;
+
+        if (ast_mode)
+        {
+            node = new_node(NODE_BINARY, node, right, op);
+            node_c[node] = left_typ;
+            node_d[node] = right_typ;
+            node = fold(node);
+        }
+        else
+            emit_binary(op, left_typ, right_typ);
+    }
+
+    if (level == 2) while (see(TOKEN_OR) || see(TOKEN_AND)) {
+        if (ast_mode)
+        {
+            op = see(TOKEN_OR) ? NODE_OR : NODE_AND;
+            next();
+            right = expr(level+1);
+            node = new_node(op, node, right, 0);
+        }
+        else
+        {
+            int shortcircuit = new_label();
+
+            emit_imm("cmp", "rax", 0);
+            emit_jump(see(TOKEN_OR) ? "jnz" : "jz", shortcircuit);
+            next();
+            expr(level+1);
+
+            emit_label(shortcircuit);
+        }
+    }
+
+    if (level == 1 && try_match(TOKEN_QUESTION))
+    {
+        node = branch(true, node);
+    }
+
+
+    if (level == 0 && try_match(TOKEN_ASSIGN))
+    {//
+        /// a=123;
+        /// a=func1();
+        if (!ast_mode)
+            emit_ins("push", "rax", 0);
+
+        needs_lvalue("assignment requires a modifiable object\n");
+        right = expr(level+1);
+        right_typ=typ;
+
+        if (ast_mode)
+            node = new_node(NODE_ASSIGN, node, right, left_typ==TYPE_CHAR);
+        else
+            emit_store(left_typ==TYPE_CHAR);
+    }
+
+    return node;
+}
+
+int statmens ();
+
+int branch (bool isexpr, int cond)
+{
+    int false_branch = 0;
+    int join = 0;
+    int then = 0;
+    int otherwise = 0;
+    int node = 0;
+
+    if (!ast_mode) {
+        false_branch = new_label();
+        join = new_label();
+
+        emit_imm("cmp", "rax", 0);
+        emit_jump("je", false_branch);
+    }
+
+    then = isexpr ? expr(1) : statmens();
+
+    if (!ast_mode) {
+        emit_jump("jmp", join);
+        emit_label(false_branch);
+    }
+
+    if (isexpr) {
+        must_match(TOKEN_COLON);
+        otherwise = expr(1);
+
+    } else if (try_match(TOKEN_KW_ELSE))
+        otherwise = statmens();
+
+    if (ast_mode) {
+        node = new_node(isexpr ? NODE_COND : NODE_IF, cond, then, 0);
+        node_c[node] = otherwise;
+
+    } else
+        emit_label(join);
+
+    return node;
+}
+
+int if_branch () {
+    int cond = 0;
+    must_match(TOKEN_KW_IF);
+    must_match(TOKEN_LPAREN);
+    cond = expr(0);
+    must_match(TOKEN_RPAREN);
+    return branch(false, cond);
+}
+int for_loop(){
+
+    int if_jmp_start=new_label();
+    int every_loop_add=new_label();
+    int loop_body_start=new_label();
+    int loop_end=new_label();
+    int init = 0;
+    int cond = 0;
+    int step = 0;
+    int body = 0;
+    int node = 0;
+
+    must_match(TOKEN_KW_FOR);
+    must_match(TOKEN_LPAREN);
+    init = statmens();
+
+    if (!ast_mode)
+        emit_label(if_jmp_start);
+
+    cond = statmens();
+
+    if (!ast_mode) {
+        emit_imm("cmp", "rax", 0);
+        emit_jump("jne", loop_body_start);
+        emit_imm("cmp", "rax", 0);
+        emit_jump("je", loop_end);
+
+        emit_label(every_loop_add);
+    }
+
+    step = expr(0);
+    must_match(TOKEN_RPAREN);
+
+    if (!ast_mode) {
+        emit_jump("jmp", if_jmp_start);
+
+
+        emit_label(loop_body_start);
+    }
+
+    body = statmens();
+
+    if (ast_mode) {
+        node = new_node(NODE_FOR, init, cond, 0);
+        node_c[node] = step;
+        node_d[node] = body;
+
+    } else {
+        emit_jump("jmp", every_loop_add);
+
+        emit_label(loop_end);
+    }
+
+    return node;
+}
+int while_loop () {
+    int loop_to = 0;
+    int break_to = 0;
+    int cond = 0;
+    int body = 0;
+
+    if (!ast_mode) {
+        loop_to = emit_label(new_label());
+        break_to = new_label();
+    }
+
+    bool do_while = try_match(TOKEN_KW_DO);
+
+    if (do_while)
+        body = statmens();
+
+    must_match(TOKEN_KW_WHILE);
+    must_match(TOKEN_LPAREN);
+    cond = expr(0);
+    must_match(TOKEN_RPAREN);
+
+    if (!ast_mode)
+    {
+        emit_imm("cmp", "rax", 0);
+        emit_jump("je", break_to);
+    }
+
+    if (do_while)
+        must_match(TOKEN_SEMI);
+
+    else
+        body = statmens();
+
+    if (ast_mode)
+        return new_node(do_while ? NODE_DO : NODE_WHILE, cond, body, 0);
+
+    emit_jump("jmp", loop_to);
+    emit_label(break_to);
+    return 0;
+}
+
+int decl (int kind);
+
+//See decl() implementation
+int DECL_MODULE = 1;
+int DECL_LOCAL = 2;
+int DECL_PARAM = 3;
 
 ///
-/// \brief factor
+/// \brief line stat. 一个语句???
 ///
-///一.lea指令:
-///对于寄存器来说:第二个操作数是寄存器必须要加[],不然报错,这里lea就是取[寄存器]的值,如:
-/// mov eax,2
-/// lea ebx,[eax];执行后ebx=2
-/// mov ebx,eax;等同于上句
-/// lea ebx,eax;编译器报错: error A2070: invalid instruction operands
-/// 对于变量来说加不加[]都是一样的效果,都是取变量的地址,相当于指针
-/// 如:
-/// num dword 2
-/// lea ebx,num
-/// lea eax,[num]; eax为num的地址,如eax=4206598,随程序不同不同,这时ebx==eax
-///二.mov指令:
-/// 对于变量来说
-/// num dword 2
-/// mov eax,2
-/// mov ebx,num
-/// mov ecx,[num];执行完ebx==ecx==2
-/// 对寄存器
-/// mov ebx,eax;ebx==2
-/// mov ecx,[eax];可能会报错,因为这里翻译成汇编是mov ecx,DS:[eax]
-/// 总的说来加不加中括号[]的区别就是:
-/// lea对变量没有影响是取地址,对寄存器来说加[]时取值,第二操作数不加[]非法
-/// mov对变量来说没有影响是取值,对寄存器来说是加[]时取地址,第二操作数不加[]是取值
+int statmens ()
+{
+    int node = 0;
+    int last = 0;
+    int stmt = 0;
+
+    if (see(TOKEN_KW_IF))
+        node = if_branch();
+
+    else if (see(TOKEN_KW_WHILE) || see(TOKEN_KW_DO))
+        node = while_loop();
+    else if(see(TOKEN_KW_FOR))
+        node = for_loop();
+    else if (see(TOKEN_KW_INT) || see(TOKEN_KW_CHAR) || see(TOKEN_KW_BOOL))
+    {
+        ///局部变量
+        node = decl(DECL_LOCAL);
+    }
+    else if (try_match(TOKEN_LBRACE))
+    {
+        if (ast_mode)
+            node = new_node(NODE_BLOCK, 0, 0, 0);
+
+        while (waiting_for(TOKEN_RBRACE))
+        {
+            stmt = statmens();
+
+            if (stmt && last)
+                node_next[last] = stmt;
+            else if (stmt)
+                node_a[node] = stmt;
+
+            if (stmt)
+                last = stmt;
+        }
+
+        must_match(TOKEN_RBRACE);
+
+    }
+    else
+    {
+        bool ret = try_match(TOKEN_KW_RETURN);
+
+        if (waiting_for(TOKEN_SEMI))
+            node = expr(0);
+
+        if (ast_mode && ret)
+            node = new_node(NODE_RETURN, node, 0, 0);
+
+        else if (ast_mode && node)
+            node = new_node(NODE_EXPR, node, 0, 0);
+
+        else if (ret)
+            emit_jump("jmp", return_to);
+
+        must_match(TOKEN_SEMI);
+    }
+
+    return node;
+}
+
+//==== Tree code generator ====
+
+void gen_expr (int node);
+void gen_stmt (int node);
+
+///局部变量分到的寄存器，没有则为0
+int local_reg (int node) {
+    return node_kind[node] == NODE_LOCAL ? sym_reg[node_b[node]] : 0;
+}
+
+///叶子节点的操作数：立即数、寄存器或内存
+char* operand (int node) {
+    int kind = node_kind[node];
 
-void factor ()
-{
-    lvalue = false;
-    typ=TYPE_UNKNOWN;
-    if (see("true") || see("false"))
+    char* p = opnd;
+
+    if (local_reg(node))
+        return var_reg[local_reg(node) - 1];
+
+    if (kind == NODE_NUM)
+        p = put_digits(p, node_val[node], 1);
+
+    else if (kind == NODE_GLOBAL)
     {
-        fprintf(output, "mov rax, %d\n", see("true") ? 1 : 0);
-        next();
+        p = put_text(p, "[");
+        p = put_text(p, sym_name[node_val[node]]);
+        p = put_text(p, "]");
     }
-    else if (token == TOKEN_IDENT)
+    else
     {
-        int global = sym_lookup(globals, global_no, buffer);
-        int local = sym_lookup(locals, local_no, buffer);
+        p = put_text(p, "[rbp");
 
-        require(global >= 0 || local >= 0, "no symbol '%s' declared\n");
-        next();
+        if (node_val[node] >= 0)
+            p = put_text(p, "+");
 
-        if (see("=") || see("++") || see("--"))
-        {
-            ///如果有 a=121; 或 a++; 或a--;则 a要保留左值
-            lvalue = true;
-        }
+        p = put_digits(p, node_val[node], 1);
+        p = put_text(p, "]");
+    }
 
-        ///FIXME: 此处应该是先局部变量，再全局变量???
-        if (local >= 0)
-        {
-            /// 局部变量，通过栈指针获取
-            fprintf(output, "%s rax, [rbp%+d]\n", lvalue ? "lea" : "mov", offsets[local]);
-            typ=locals_type[local];
-        }
-        else  if (global >= 0)
+    p[0] = 0;
+    return opnd;
+}
+
+///把rax放到一个临时寄存器中
+char* hold () {
+    char* reg = temp_reg[temp_no++];
+    emit_ins("mov", reg, "rax");
+    return reg;
+}
+
+///右边没有函数调用时，左边的值可以留在临时寄存器中
+bool can_hold (int node) {
+    return temp_no < temp_max && !node_calls[node];
+}
+
+///lhs op rhs，结果在rax中，lhs和rhs中有一个是rax
+///target非0时，比较的结果不放到rax中，而是结果等于when时跳到target
+void emit_op (int op, char* lhs, char* rhs, bool left_char, bool right_char, int target, bool when) {
+    char* instr = binop_instr[op];
+
+    if (binop_level[op] == 3)
+    {
+        if (left_char)
+            emit_ins("and", lhs, "0xff");
+
+        if (right_char)
+            emit_ins("and", rhs, "0xff");
+
+        emit_ins("cmp", lhs, rhs);
+
+        if (target)
+            emit_jump(ins_join("j", when ? instr : binop_negated[op]), target);
+
+        else
         {
-            ///全局变量，通过变量名读取
-            /// 全局函数，外部和内部的调用方式不一致，所以此处需要记录???
-            fprintf(output, "%s rax, [%s]\n", is_fn[global] || lvalue ? "lea" : "mov", globals[global]);
-            curr_is_extern=is_extern[global];
-            typ = globals_type[global];
+            emit_imm("mov", "rax", 0);
+            emit_ins(ins_join("set", instr), "al", 0);
         }
     }
-    else if (token == TOKEN_INT)
+    else if (strcmp(lhs, "rax") == 0)
+        emit_ins(instr, "rax", rhs);
+
+    else if (op != TOKEN_MINUS)
+        emit_ins(instr, "rax", lhs);
+
+    else
     {
-        fprintf(output, "mov rax, %s\n", buffer);
-        next();
+        emit_ins("sub", lhs, "rax");
+        emit_ins("mov", "rax", lhs);
     }
-    else if(token==TOKEN_CHAR)
+}
+
+void gen_binary (int node, int target, bool when) {
+    int left = node_a[node];
+    int right = node_b[node];
+    int op = node_val[node];
+    bool left_char = node_c[node] == TYPE_CHAR;
+    bool right_char = node_d[node] == TYPE_CHAR;
+    char* reg = 0;
+
+    if (is_operand(right) && !right_char)
     {
-        int char_out = 0;
-        if(buffer[1]!='\\')
+        gen_expr(left);
+        emit_op(op, "rax", operand(right), left_char, false, target, when);
+    }
+    else if (temp_no < temp_max && is_pure(left) && is_pure(right) && node_need[right] > node_need[left])
+    {
+        //Sethi-Ullman: the side needing more registers goes first
+        gen_expr(right);
+        reg = hold();
+        gen_expr(left);
+        emit_op(op, "rax", reg, left_char, right_char, target, when);
+        temp_no--;
+    }
+    else if (can_hold(right))
+    {
+        gen_expr(left);
+        reg = hold();
+        gen_expr(right);
+        emit_op(op, reg, "rax", left_char, right_char, target, when);
+        temp_no--;
+    }
+    else
+    {
+        gen_expr(left);
+        emit_ins("push", "rax", 0);
+        gen_expr(right);
+
+        if (target)
         {
-            //不是特殊字符，直接返回
-            fprintf(output, "mov rax, %s\n", buffer);
+            emit_ins("pop", "r11", 0);
+            emit_op(op, "r11", "rax", left_char, right_char, target, when);
         }
         else
-        {
-            char_out = char_preprocess(buffer+1);
-            fprintf(output, "mov rax, %u\n", char_out);
-        }
-        next();
+            emit_binary(op, node_c[node], node_d[node]);
     }
-    else if (token == TOKEN_STR)
+}
+
+///数组元素：instr是mov取值，lea取地址
+void gen_index (int node, char* instr) {
+    int base = node_a[node];
+    int index = node_b[node];
+    int scale = node_val[node];
+    char* reg = 0;
+
+    //A local array needs no base register, its elements are at rbp+off
+    if (node_kind[base] == NODE_ARRAY && node_kind[index] == NODE_NUM)
+        emit_load(instr, "rax", "rbp", node_val[base] + (node_val[index]*scale));
+
+    else if (node_kind[base] == NODE_ARRAY && local_reg(index))
+        emit_scaled_local(instr, var_reg[local_reg(index) - 1], scale, node_val[base]);
+
+    else if (node_kind[base] == NODE_ARRAY)
     {
-        ///20221215
-        /// 字符串不再在此处生成，而是保存下来，放在后期生成
-        ///
-        int str =0;
-        str = new_label();
-        fprintf(output, "lea rax,  [_%08d]\n", str);
-        const_strs_label[const_strs_no]=str;
-        const_strs[const_strs_no]=strdup(buffer);
-        //printf("currln=%d, id=%d %s\n", curln,str, const_strs[const_strs_no]);
-
-        const_strs_no++;
-        next();
-        while (token == TOKEN_STR)
-        {
-            char *str_n = malloc(1024);
-            char *str_old = const_strs[const_strs_no-1];
-            int len_old = strlen(str_old);
-            (str_old+len_old-1)[0]=0;//去除最后的"
-            sprintf(str_n, "%s%s",str_old, buffer+1);//buffer是去除最前面的双引号
-            ///如果下一个还是字符串，则将下一个字符串放入上一个字符串
-            /// 两个字符串连接在一起
-            const_strs[const_strs_no-1]=strdup(str_n);
-            free(str_n);
-            next();
-        }
+        gen_expr(index);
+        emit_scaled_local(instr, "rax", scale, node_val[base]);
+    }
+    else if (node_kind[index] == NODE_NUM)
+    {
+        gen_expr(base);
+        emit_load(instr, "rax", "rax", node_val[index]*scale);
+    }
+    else if (local_reg(index))
+    {
+        gen_expr(base);
+        emit_scaled(instr, var_reg[local_reg(index) - 1], scale, "rax");
     }
-    else if (try_match("("))
+    else if (temp_no < temp_max && is_pure(base) && is_pure(index) && node_need[index] > node_need[base])
     {
-        expr(0);
-        must_match(")");
+        gen_expr(index);
+        reg = hold();
+        gen_expr(base);
+        emit_scaled(instr, reg, scale, "rax");
+        temp_no--;
+    }
+    else if (can_hold(index))
+    {
+        gen_expr(base);
+        reg = hold();
+        gen_expr(index);
+        emit_scaled(instr, "rax", scale, reg);
+        temp_no--;
     }
     else
     {
-        error("expected an expression, found '%s'\n");
+        gen_expr(base);
+        emit_ins("push", "rax", 0);
+        gen_expr(index);
+        emit_ins("pop", "r11", 0);
+        emit_scaled(instr, "rax", scale, "r11");
     }
 }
 
-void object () {
-    int i = 0;
-    int local_curr_extern = 0;
-    factor();
+///把左值的地址放到rax中
+void gen_addr (int node) {
+    int kind = node_kind[node];
 
-    while (true) {
-        if (try_match("("))
-        {
-            ///x64中，每个函数调用，栈中必须至少有4个位置
-            /// 栈必须是16字节对齐的
-            ///
-            /// 此处预留4个位置，避免只有1个参数时，栈中其它数值被调用函数覆盖
-            fputs("sub rsp, 8*4\n",output);
+    if (kind == NODE_LOCAL)
+        emit_load("lea", "rax", "rbp", node_val[node]);
 
-            ///函数指针
-            fputs("push rax\n", output);
-            local_curr_extern = curr_is_extern;///此处记录，避免在解析参数时，被函数调用的参数覆盖
+    else if (kind == NODE_GLOBAL)
+        emit_sym("lea", "rax", sym_name[node_val[node]]);
 
-            /// 此处是函数调用:
-            /// 4个参数，从左到右，依次放入  - RCX、RDX、R8 和 R9
-            /// func1(a,b,c);
+    else if (kind == NODE_INDEX)
+        gen_index(node, "lea");
 
-            int arg_no = 0;
+    else
+        gen_expr(node);
+}
 
-            if (waiting_for(")"))
-            {
-                //cdecl requires arguments to be pushed on backwards
-                
-                int start_label = new_label();
-                int end_label = new_label();
-                int prev_label = end_label;
+void gen_assign (int node) {
+    int left = node_a[node];
+    int right = node_b[node];
+    bool byte = node_val[node];
+    int reg = local_reg(left);
+    char* addr = 0;
 
-                fprintf(output, "jmp _%08d\n", start_label);
+    if (reg)
+    {
+        gen_expr(right);
 
-                do {
-                    int next_label = emit_label(new_label());
-                    expr(0);
-                    fprintf(output, "push rax\n"
-                                    "jmp _%08d\n", prev_label);
-                    arg_no++;
+        if (byte)
+            emit_ins("movzx", var_reg32[reg - 1], "al");
+        else
+            emit_ins("mov", var_reg[reg - 1], "rax");
+    }
+    else if (node_kind[left] == NODE_LOCAL || node_kind[left] == NODE_GLOBAL)
+    {
+        gen_expr(right);
+        emit_ins("mov", byte ? ins_join("byte ", operand(left)) : operand(left), byte ? "al" : "rax");
+    }
+    else if (can_hold(right))
+    {
+        gen_addr(left);
+        addr = hold();
+        gen_expr(right);
+        emit_save(addr, 0, byte ? "al" : "rax");
+        temp_no--;
+    }
+    else
+    {
+        gen_addr(left);
+        emit_ins("push", "rax", 0);
+        gen_expr(right);
+        emit_store(byte);
+    }
+}
 
-                    prev_label = next_label;
-                } while (try_match(","));
+void gen_post_step (int node) {
+    int target = node_a[node];
+    bool inc = node_kind[node] == NODE_POST_INC;
 
-                fprintf(output, "_%08d:\n", start_label);
-                fprintf(output, "jmp _%08d\n", prev_label);
-                fprintf(output, "_%08d:\n", end_label);
-            }
+    if (is_operand(target))
+    {
+        emit_ins("mov", "rax", operand(target));
+        emit_ins(inc ? "add" : "sub", local_reg(target) ? operand(target) : ins_join("qword ", operand(target)), "1");
+    }
+    else
+    {
+        gen_addr(target);
+        emit_post_step(inc);
+    }
+}
 
-            must_match(")");
+///把一个参数求值到寄存器中
+void gen_arg (int arg, char* reg) {
+    int kind = node_kind[arg];
 
-            /// dword ptr
-            /// 此处进行函数调用
-            ///
-            for(i=0;i<arg_no;i++)
-            {
-                if (i==0)
-                {
-                    fprintf(output, "mov rcx, qword[rsp+%d]\n", (i)*WORD_SIZE);
-                }
-                else if(i==1)
-                {
-                    fprintf(output, "mov rdx, qword[rsp+%d]\n", (i)*WORD_SIZE);
-                }
-                else if(i==2)
-                {
-                    fprintf(output, "mov r8, qword[rsp+%d]\n", (i)*WORD_SIZE);
-                }
-                else if(i==3)
-                {
-                    fprintf(output, "mov r9, qword[rsp+%d]\n", (i)*WORD_SIZE);
-                }
-            }
+    if (is_operand(arg))
+        emit_ins("mov", reg, operand(arg));
 
-            ///将函数地址取出并调用
-            if (local_curr_extern)
-            {
-                fprintf(output, "mov rax,qword [rsp+%d]\n",(arg_no)*WORD_SIZE);
-            }
-            else
-            {
-                fprintf(output, "lea rax,qword [rsp+%d]\n",(arg_no)*WORD_SIZE);
-            }
-            fprintf(output, "call qword [rax]\n");
-            fprintf(output, "add rsp, %d\n", (arg_no+1)*WORD_SIZE);
+    else if (kind == NODE_STR)
+        emit_label_addr(reg, node_val[arg]);
 
-            /// 回收预留的位置---此处预留4个位置，避免只有1个参数时，栈中其它数值被调用函数覆盖
-            fputs("add rsp, 8*4\n",output);
+    else if (kind == NODE_GLOBAL)
+        emit_sym("lea", reg, sym_name[node_val[arg]]);
 
-        }
-        else if (try_match("["))
-        {
-            int lv_typ;
-            lv_typ = typ;//先记录下类型，避免后期被覆盖
-            /// 中括号：
-            /// 1 push eax; 先将左值eax放入栈
-            /// 2 val->eax求中括号内的表达式的值（默认会放入eax中）
-            /// 3 pop ebx; lea/mov eax, [eax*d+ebx]
-            fputs("push rax\n", output);
+    else
+    {
+        gen_expr(arg);
+        emit_ins("mov", reg, "rax");
+    }
+}
 
-            expr(0);
-            must_match("]");
+///第i个参数在调用区中的位置
+//Win64 passes argument i at [rsp+8*i], over the shadow space of the
+//register arguments. System V passes only the stack arguments there, so
+//the register arguments get the slots after them.
+int arg_slot (int i, int arg_no) {
+    if (abi == ABI_MS)
+        return i;
 
-            if (see("=") || see("++") || see("--"))
-                lvalue = true;
+    if (i >= ARG_REGS)
+        return i - ARG_REGS;
+
+    return max_int(arg_no - ARG_REGS, 0) + i;
+}
 
+///调用区的位置数
+//System V needs the area only for stack arguments and for arguments that
+//make calls, which are kept there while the others are evaluated. When
+//every argument goes straight into its register, nothing is reserved.
+int call_slots (int node) {
+    int arg_no = node_c[node];
+    int arg = 0;
+    int i = 0;
 
-            if (lv_typ==TYPE_CHAR_PTR)
-            {
-                fprintf(output, "pop rbx\n"
-                                "%s rax, [rax*%d+rbx]\n", lvalue ? "lea" : "mov", 1);
-                typ = TYPE_CHAR;
-            }
-            else
-            {
-                fprintf(output, "pop rbx\n"
-                                "%s rax, [rax*%d+rbx]\n", lvalue ? "lea" : "mov", WORD_SIZE);
+    if (abi == ABI_MS)
+        return max_int(arg_no, 4);
 
-                if (lv_typ==TYPE_CHAR_PTR_PTR)
-                    typ=TYPE_CHAR_PTR;
-                else
-                    typ=TYPE_INT;
-            }
+    for (arg = node_b[node]; arg; arg = node_next[arg])
+    {
+        if (i >= ARG_REGS || node_calls[arg])
+            return arg_no;
 
-        }
-        else
-        {
-            return ;
-        }
+        i++;
     }
+
+    return 0;
 }
 
-void unary () {
-    if (try_match("!"))
-    {
-        /// last in first out.
-        //Recurse to allow chains of unary operations, LIFO order
-        unary();
+//The outgoing area is reserved first, if it is needed at all. On Win64
+//the callee needs at least four slots. Arguments that make calls, and
+//those past the register ones, are stored there first. The remaining
+//register arguments are then evaluated straight into their registers,
+//with only r10 left as scratch so they cannot overwrite each other.
+void gen_call (int node) {
+    int callee = node_a[node];
+    int arg_no = node_c[node];
+    int slots = call_slots(node);
+    int sym = -1;
+    int arg = 0;
+    int i = 0;
+    int max = temp_max;
+
+    if (node_kind[callee] == NODE_GLOBAL && sym_is_fn[node_val[callee]])
+        sym = node_val[callee];
+    else
+        slots++;
 
-        fputs("cmp rax, 0\n"
-              "mov rax, 0\n"
-              "sete al\n", output);
+    if (needs_align(sym))
+        emit_align(slots);
 
-    }
-    else if (try_match("-"))
-    {
-        unary();
-        fputs("neg rax\n", output);
+    if (slots)
+        emit_imm("sub", "rsp", slots*WORD_SIZE);
 
-    } else
+    if (sym < 0)
     {
-        //This function call compiles itself
-        object();
+        gen_expr(callee);
+        emit_save("rsp", (slots-1)*WORD_SIZE, "rax");
+    }
 
-        if (see("++") || see("--"))
+    for (arg = node_b[node]; arg; arg = node_next[arg])
+    {
+        if (i >= ARG_REGS || node_calls[arg])
         {
-            fprintf(output, "mov rbx, rax\n"
-                            "mov rax, [rbx]\n"
-                            "%s qword [rbx], 1\n", see("++") ? "add" : "sub");
-            //%s dword ptr [rbx], 1
-            needs_lvalue("assignment operator '%s' requires a modifiable object\n");
-            next();
+            if (local_reg(arg))
+                emit_save("rsp", arg_slot(i, arg_no)*WORD_SIZE, operand(arg));
+
+            else if (node_kind[arg] == NODE_NUM)
+            {
+                emit_ins("mov", ins_join("qword ", ins_mem("rsp", arg_slot(i, arg_no)*WORD_SIZE)), ins_number(node_val[arg]));
+            }
+            else
+            {
+                gen_expr(arg);
+                emit_save("rsp", arg_slot(i, arg_no)*WORD_SIZE, "rax");
+            }
         }
-    }
-}
 
-void branch (bool expr);
+        i++;
+    }
 
-void expr (int level)
-{
-    ///通过level解决优先级问题
-    ///
-    ///
+    temp_max = 1;
+    i = 0;
 
-    if (level == 5)
+    for (arg = node_b[node]; arg && i < ARG_REGS; arg = node_next[arg])
     {
-        // 如果5级了。可以 处理单目运算符，并返回
-        unary();
-        return;
-    }
-
-    int left_typ=TYPE_INT;
-    int right_typ = TYPE_INT;
+        if (!node_calls[arg])
+            gen_arg(arg, arg_reg[i]);
 
-    ///否则，先去处理更高优先级的表达式
-    expr(level+1);
+        i++;
+    }
 
-    left_typ = typ;
+    temp_max = max;
+    i = 0;
 
-    while (  level == 4 ? see("+") || see("-") || see("*")
-             : level == 3 ? see("==") || see("!=") || see("<") || see(">=")|| see(">")
-             : false)
+    for (arg = node_b[node]; arg && i < ARG_REGS; arg = node_next[arg])
     {
-        ///优先级4: +-*
-        /// 优先级3: == != < >=
-        fputs("push rax\n", output);
+        if (node_calls[arg])
+            emit_load("mov", arg_reg[i], "rsp", arg_slot(i, arg_no)*WORD_SIZE);
 
-        char* instr = see("+") ? "add" : see("-") ? "sub" : see("*") ? "imul" :
-                                                                       see("==") ? "e" : see("!=") ? "ne" : see("<") ? "l" : see(">=")? "ge" :"g";
+        i++;
+    }
 
-        next();
-        expr(level+1);
-        right_typ = typ;
+    if (needs_align(sym))
+        emit_ins("xor", "eax", "eax");
 
-        if (level == 4)
-        {/// +-* 数据
-            fprintf(output, "mov rbx, rax\n"
-                            "pop rax\n"
-                            "%s rax, rbx\n", instr);
-        }
+    emit_call_insn(sym, (slots-1)*WORD_SIZE);
 
-        else
-        {/// == != < > >= 判断
-            fputs("pop rbx\n",output);
+    if (needs_align(sym))
+        emit_unalign(slots);
 
-            if(left_typ==TYPE_CHAR)
-            {
-                fputs("and rbx, 0xff\n", output);
-            }
-            if(right_typ==TYPE_CHAR)
-            {
-                fputs("and rax, 0xff\n", output);
-            }
-            fprintf(output, "cmp rbx, rax\n"
-                            "mov rax, 0\n"
-                            "set%s al\n", instr);
-        }
-    }
+    else if (slots)
+        emit_imm("add", "rsp", slots*WORD_SIZE);
+}
 
-    if (level == 2) while (see("||") || see("&&")) {
-        int shortcircuit = new_label();
+///条件直接变成跳转：node的值为真（when为true）或为假时跳到label，否则往下执行
+//Comparisons become a cmp and a jcc, and && and || become chains of
+//jumps, so no boolean is materialized in rax
+void gen_cond (int node, int label, bool when) {
+    int kind = node_kind[node];
+    int skip = 0;
 
-        fprintf(output, "cmp rax, 0\n"
-                        "j%s _%08d\n", see("||") ? "nz" : "z", shortcircuit);
-        next();
-        expr(level+1);
+    if (kind == NODE_NUM)
+    {
+        if (when ? node_val[node] != 0 : node_val[node] == 0)
+            emit_jump("jmp", label);
+    }
+    else if (kind == NODE_NOT)
+        gen_cond(node_a[node], label, !when);
 
-        fprintf(output, "\t_%08d:\n", shortcircuit);
+    else if ((kind == NODE_AND || kind == NODE_OR) && (kind == NODE_OR) == when)
+    {
+        //a || b jumps as soon as either is true, a && b as soon as either is false
+        gen_cond(node_a[node], label, when);
+        gen_cond(node_b[node], label, when);
+    }
+    else if (kind == NODE_AND || kind == NODE_OR)
+    {
+        skip = new_label();
+        gen_cond(node_a[node], skip, !when);
+        gen_cond(node_b[node], label, when);
+        emit_label(skip);
     }
+    else if (kind == NODE_BINARY && binop_level[node_val[node]] == 3)
+        gen_binary(node, label, when);
 
-    if (level == 1 && try_match("?"))
+    else
     {
-        branch(true);
+        gen_expr(node);
+        emit_imm("cmp", "rax", 0);
+        emit_jump(when ? "jne" : "je", label);
     }
+}
 
+void gen_branch (int node, bool isexpr) {
+    int false_branch = new_label();
+    int join = new_label();
 
-    if (level == 0 && try_match("="))
-    {//
-        /// a=123;
-        /// a=func1();
-        fputs("push rax\n", output);
+    gen_cond(node_a[node], false_branch, false);
 
-        needs_lvalue("assignment requires a modifiable object\n");
-        expr(level+1);
-        right_typ=typ;
-        fputs("pop rbx\n",output);
-        if(left_typ==TYPE_CHAR)
-        {
-            fputs("mov byte [rbx], al\n", output);//dword ptr
-        }
-        else
-        {
-            fputs("mov  [rbx], rax\n", output);//dword ptr
-        }
-    }
+    isexpr ? gen_expr(node_b[node]) : gen_stmt(node_b[node]);
+
+    emit_jump("jmp", join);
+    emit_label(false_branch);
 
+    isexpr ? gen_expr(node_c[node]) : gen_stmt(node_c[node]);
+
+    emit_label(join);
 }
 
-void statmens ();
+void gen_expr (int node) {
+    int kind = node_kind[node];
+    int label = 0;
 
-void branch (bool isexpr)
-{
-    int false_branch = new_label();
-    int join = new_label();
+    if (kind == NODE_NUM)
+        emit_imm("mov", "rax", node_val[node]);
 
-    fprintf(output, "cmp rax, 0\n"
-                    "je _%08d\n", false_branch);
+    else if (kind == NODE_STR)
+        emit_label_addr("rax", node_val[node]);
 
-    isexpr ? expr(1) : statmens();
+    else if (kind == NODE_LOCAL)
+        emit_ins("mov", "rax", operand(node));
 
-    fprintf(output, "jmp _%08d\n", join);
-    fprintf(output, "\t_%08d:\n", false_branch);
+    else if (kind == NODE_ARRAY)
+        emit_load("lea", "rax", "rbp", node_val[node]);
 
-    if (isexpr) {
-        must_match(":");
-        expr(1);
+    else if (kind == NODE_WIDE)
+        emit_ins("mov", "rax", wide_text[node_val[node]]);
 
-    } else if (try_match("else"))
-        statmens();
+    else if (kind == NODE_GLOBAL)
+        emit_sym(sym_is_fn[node_val[node]] ? "lea" : "mov", "rax", sym_name[node_val[node]]);
 
-    fprintf(output, "\t_%08d:\n", join);
-}
+    else if (kind == NODE_CALL)
+    {
+        gen_call(node);
+    }
+    else if (kind == NODE_INDEX)
+        gen_index(node, "mov");
+
+    else if (kind == NODE_NOT)
+    {
+        gen_expr(node_a[node]);
+        emit_imm("cmp", "rax", 0);
+        emit_imm("mov", "rax", 0);
+        emit_ins("sete", "al", 0);
+    }
+    else if (kind == NODE_NEG)
+    {
+        gen_expr(node_a[node]);
+        emit_ins("neg", "rax", 0);
+    }
+    else if (kind == NODE_POST_INC || kind == NODE_POST_DEC)
+        gen_post_step(node);
+
+    else if (kind == NODE_BINARY)
+        gen_binary(node, 0, false);
+
+    else if (kind == NODE_AND || kind == NODE_OR)
+    {
+        label = new_label();
+        gen_expr(node_a[node]);
+        emit_imm("cmp", "rax", 0);
+        emit_jump(kind == NODE_OR ? "jnz" : "jz", label);
+        gen_expr(node_b[node]);
+        emit_label(label);
+    }
+    else if (kind == NODE_COND)
+        gen_branch(node, true);
 
-void if_branch () {
-    must_match("if");
-    must_match("(");
-    expr(0);
-    must_match(")");
-    branch(false);
+    else if (kind == NODE_ASSIGN)
+        gen_assign(node);
 }
-void for_loop(){
 
-    int if_jmp_start=new_label();
-    int every_loop_add=new_label();
-    int loop_body_start=new_label();
-    int loop_end=new_label();
+void gen_stmt (int node) {
+    int kind = node_kind[node];
+    int stmt = 0;
+    int loop_to = 0;
+    int cond = 0;
+    int body = 0;
+    int break_to = 0;
+
+    if (kind == NODE_EXPR)
+        gen_expr(node_a[node]);
+
+    else if (kind == NODE_RETURN)
+    {
+        gen_expr(node_a[node]);
+        emit_jump("jmp", return_to);
+    }
+    else if (kind == NODE_BLOCK)
+    {
+        for (stmt = node_a[node]; stmt; stmt = node_next[stmt])
+            gen_stmt(stmt);
+    }
+    else if (kind == NODE_IF)
+        gen_branch(node, false);
 
-    must_match("for");
-    must_match("(");
-    statmens();
+    else if (kind == NODE_WHILE || kind == NODE_DO || kind == NODE_FOR)
+    {
+        //Rotated: the condition is tested once on entry, then at the
+        //bottom, with a single backward branch per iteration
+        loop_to = new_label();
+        break_to = new_label();
+        cond = node_a[node];
+        body = node_b[node];
+
+        if (kind == NODE_FOR)
+        {
+            gen_stmt(node_a[node]);
 
-    emit_label(if_jmp_start);
-    statmens();
+            //An empty condition is always true
+            cond = node_b[node] ? node_a[node_b[node]] : 0;
+            body = node_d[node];
+        }
 
-    fprintf(output, "cmp rax, 0\n"
-                    "jne _%08d\n", loop_body_start);
-    fprintf(output, "cmp rax, 0\n"
-                    "je _%08d\n", loop_end);
+        if (kind != NODE_DO && cond)
+            gen_cond(cond, break_to, false);
 
-    emit_label(every_loop_add);
-    expr(0);
-    must_match(")");
+        emit_label(loop_to);
+        gen_stmt(body);
 
-    fprintf(output, "jmp _%08d\n", if_jmp_start);
+        if (kind == NODE_FOR)
+            gen_expr(node_c[node]);
 
+        if (cond)
+            gen_cond(cond, loop_to, true);
+        else
+            emit_jump("jmp", loop_to);
 
-    emit_label(loop_body_start);
-    statmens();
-    fprintf(output, "jmp _%08d\n", every_loop_add);
+        emit_label(break_to);
+    }
+    else if (kind == NODE_INIT)
+    {
+        gen_expr(node_a[node]);
 
-    emit_label(loop_end);
+        if (sym_reg[node_b[node]])
+            emit_ins("mov", var_reg[sym_reg[node_b[node]] - 1], "rax");
+        else
+            emit_save("rbp", node_val[node], "rax");
+    }
 }
-void while_loop () {
-    int loop_to = emit_label(new_label());
-    int break_to = new_label();
 
-    bool do_while = try_match("do");
+void gen_function (char* ident, int body) {
+    int i = 0;
+    return_to = new_label();
 
-    if (do_while)
-        statmens();
+    ///先给局部变量分配寄存器
+    propagate_consts(body);
 
-    must_match("while");
-    must_match("(");
-    expr(0);
-    must_match(")");
+    fn_no++;
+    fn_var_no = 0;
+    loop_no = 0;
+    scan_pos = 0;
+    fn_calls = false;
+    scan(body, 0);
+    alloc_regs();
 
-    fprintf(output, "cmp rax, 0\n"
-                    "je _%08d\n", break_to);
+    has_frame = fn_calls || saved_no > 0 || array_no > 0;
 
-    if (do_while)
-        must_match(";");
+    for (i = 0; i < fn_var_no; i++)
+    {
+        if (sym_reg[fn_vars[i]] == 0)
+            has_frame = true;
+    }
 
-    else
-        statmens();
+    //The frame size is known by now, so the prologue can go first
+    emit_prologue(ident, local_slots() + saved_no);
 
-    fprintf(output, "jmp _%08d\n", loop_to);
-    fprintf(output, "\t_%08d:\n", break_to);
-}
+    for (i = 0; i < saved_no; i++)
+        emit_save("rbp", save_offset(i), var_reg[saved_reg[i]]);
 
-void decl (int kind);
+    emit_param_spills();
+    gen_stmt(body);
+    emit_epilogue(ident);
+    saved_no = 0;
+}
 
-//See decl() implementation
-int DECL_MODULE = 1;
-int DECL_LOCAL = 2;
-int DECL_PARAM = 3;
+void function_body (char* ident) {
+    int start = 0;
+    int prologue_at = 0;
+    char* text = 0;
+    int code_start = out_len;
+    int first_label = label_no;
+    int errors_before = errors;
 
-///
-/// \brief line stat. 一个语句???
-///
-void statmens ()
-{
-    if (see("if"))
-        if_branch();
+    if (instrument)
+        profile_add(ident);
 
-    else if (see("while") || see("do"))
-        while_loop();
-    else if(see("for"))
-        for_loop();
-    else if (see("int") || see("char") || see("bool"))
-    {
-        ///局部变量
-        decl(DECL_LOCAL);
-    }
-    else if (try_match("{"))
-    {
-        while (waiting_for("}"))
-            statmens();
+    if (cache_dir && cache_lookup())
+        return;
 
-        must_match("}");
+    peep_begin();
 
+    if (ast_mode)
+    {
+        //A fresh tree for every function
+        node_no = 1;
+        gen_function(ident, statmens());
     }
     else
     {
-        bool ret = try_match("return");
-
-        if (waiting_for(";"))
-            expr(0);
+        //Body
+        //Only after passing the body do we know how much space to allocate for the
+        //local variables, so the body is taken back out of the output buffer
+        //and emitted again behind the prologue.
+        start = ins_capture ? ins_no : out_len;
+        return_to = new_label();
+        fn_calls = false;
+        has_frame = true;
 
-        if (ret)
-            fprintf(output, "jmp _%08d\n", return_to);
+        emit_param_spills();
 
-        must_match(";");
-    }
-}
+        statmens();
 
-void function_body (char* ident) {
-    //Body
-    int i=0;
-    int body = emit_label(new_label());
-    return_to = new_label();
+        has_frame = local_no > 0 || fn_calls;
+        emit_epilogue(ident);
 
-    ///此处是函数体内部
-    /// 应该先将参数放入堆栈，方便当前代码使用
-    for(i=0;i<param_no;i++)
-    {
-        if(i==0)
-        {
-            fprintf(output, "mov qword [rbp%+d], rcx\n",offsets[i]);
-        }
-        else if(i==1)
-        {
-            fprintf(output, "mov qword [rbp%+d], rdx\n",offsets[i]);
-        }
-        else if(i==2)
+        //Prologue
+        if (ins_capture)
         {
-            fprintf(output, "mov qword [rbp%+d], r8\n",offsets[i]);
+            prologue_at = ins_no;
+            emit_prologue(ident, local_slots());
+            ins_move_before(start, prologue_at);
         }
-        else if(i==3)
+        else
         {
-            fprintf(output, "mov qword [rbp%+d], r9\n",offsets[i]);
+            text = out_take(start);
+            emit_prologue(ident, local_slots());
+            emit(text);
         }
     }
 
-    statmens();
-
-    if(strcmp(ident, "main")==0)
-    {
-        fputs("mov rcx, 0\n",output);
-        fputs("call [ExitProcess]\n",output);
-    }
-    //Epilogue
-
-    fprintf(output, "\t_%08d:\n", return_to);
-    fputs("mov rsp, rbp\n"
-          "pop rbp\n"
-          "ret\n", output);
-    
-    //Prologue
-    //Only after passing the body do we know how much space to allocate for the
-    //local variables, so we write the prologue here at the end.
-    //fprintf(output, ".globl %s\n"
-    //                "%s:\n", ident, ident);
-    fprintf(output, "%s:\n", ident);
+    peep_end();
 
-    fprintf(output, "push rbp\n"
-                    "mov rbp, rsp\n"
-                    "sub rsp, %d\n"
-                    "jmp _%08d\n", local_no*WORD_SIZE, body);
+    if (cache_dir && errors == errors_before)
+        cache_store(code_start, first_label);
 }
 
 int try_eat_type()
 {
     typ=TYPE_UNKNOWN;
-    if(try_match("void"))
+    if(try_match(TOKEN_KW_VOID))
     {
         typ=TYPE_VOID;
-    }else   if(try_match("int"))
+    }else   if(try_match(TOKEN_KW_INT))
     {
         typ=TYPE_INT;
     }
-    else        if(try_match("FILE"))
+    else        if(try_match(TOKEN_KW_FILE))
     {
         typ=TYPE_INT;
     }
-    else if(try_match("bool"))
+    else if(try_match(TOKEN_KW_BOOL))
     {
         typ=TYPE_INT;
     }
-    else if(try_match("char"))
+    else if(try_match(TOKEN_KW_CHAR))
     {
         typ=TYPE_CHAR;
     }
     else
     {
-        //unknown type???
-        printf("unknown typ: %s. curline=%d \n", buffer, curln);
+        error("expected a type, found '%s'\n");
         return 0;
     }
 
-    if (try_match("*"))
+    if (try_match(TOKEN_STAR))
     {
         typ=typ+3;///FIXME:此处是暴力
-        if(try_match("*"))
+        if(try_match(TOKEN_STAR))
         {
             if(typ==TYPE_CHAR_PTR)
             {
@@ -1011,12 +7024,12 @@ int try_eat_type()
                 error("unsupported type:%s\n");
             }
         }
-        while(try_match("*"));
+        while(try_match(TOKEN_STAR));
     }
     return 1;
 }
 
-void decl (int kind) {
+int decl (int kind) {
     //A C declaration comes in three forms:
     // - Local decls, which end in a semicolon and can have an initializer.
     // - Parameter decls, which do not and cannot.
@@ -1025,40 +7038,55 @@ void decl (int kind) {
     bool fn = false;
     bool fn_impl = false;
     int local;
+    int node = 0;
+
+    if (kind == DECL_MODULE && cache_dir)
+        cache_begin();
 
     // this will collect the typ
     try_eat_type();
 
 
-    //Owned (freed) by the symbol table
-    char* ident = strdup(buffer);
+    int sym = sym_intern(buffer);
+    char* ident = sym_name[sym];
     next();
 
+    //Arrays, only local ones
+    if (try_match(TOKEN_LBRACKET))
+    {
+        require(kind == DECL_LOCAL, "only local variables can be arrays\n");
+        require(token == TOKEN_INT, "expected the length of the array, found '%s'\n");
+        local = new_array(sym, atoi(buffer));
+        next();
+        must_match(TOKEN_RBRACKET);
+        require(!see(TOKEN_ASSIGN), "cannot initialize an array\n");
+    }
+
     //Functions
-    if (try_match("("))
+    else if (try_match(TOKEN_LPAREN))
     {
         ///解析函数参数
         if (kind == DECL_MODULE)
             new_scope();
 
         //Params
-        if (waiting_for(")"))
+        if (waiting_for(TOKEN_RPAREN))
         {
             do
             {
                 decl(DECL_PARAM);
-            } while (try_match(","));
+            } while (try_match(TOKEN_COMMA));
         }
 
-        must_match(")");
+        must_match(TOKEN_RPAREN);
 
         ///声明新的函数
-        new_fn(ident,0);
+        new_fn(sym,0);
         fn = true;
 
         ///解析函数体
         //Body
-        if (see("{"))
+        if (see(TOKEN_LBRACE))
         {
             require(kind == DECL_MODULE, "a function implementation is illegal here\n");
 
@@ -1073,17 +7101,17 @@ void decl (int kind) {
         if (kind == DECL_LOCAL)
         {
             ///是局部变量
-            local = new_local(ident);
+            local = new_local(sym);
         } else
         {
             ///新的参数/全局变量
-            (kind == DECL_MODULE ? new_global : new_param)(ident);
+            (kind == DECL_MODULE ? new_global : new_param)(sym);
         }
     }
 
     //Initialization
 
-    if (see("="))
+    if (see(TOKEN_ASSIGN))
         require(!fn && kind != DECL_PARAM,
                 fn ? "cannot initialize a function\n" : "cannot initialize a parameter\n");
 
@@ -1091,11 +7119,11 @@ void decl (int kind) {
     {
         ///全局变量初始化，不再放在代码中间
         /// 而是放在最后
-        if (try_match("=")) {
+        if (try_match(TOKEN_ASSIGN)) {
             ///int a=1;
             if (token == TOKEN_INT)
             {
-                globals_init_val[global_no-1]=atoi(buffer);
+                sym_init_text[sym] = strdup(buffer);
             }
             next();
         }
@@ -1103,175 +7131,637 @@ void decl (int kind) {
         {
         }
     }
-    else if (try_match("="))
+    else if (try_match(TOKEN_ASSIGN))
     {
-        expr(0);
-        //dword ptr
-        fprintf(output, "mov [rbp%+d], rax\n", offsets[local]);
+        node = expr(0);
+
+        if (ast_mode)
+            node = new_node(NODE_INIT, node, local, sym_offset[local]);
+        else
+            //dword ptr
+            emit_save("rbp", sym_offset[local], "rax");
     }
 
     if (!fn_impl && kind != DECL_PARAM)
-        must_match(";");
+        must_match(TOKEN_SEMI);
+
+    return node;
 }
 
 
-void program () {
+///Win64：PE64可执行文件，用msvcrt的__getmainargs取得参数后跳到main
+void pe_header () {
+    emit("format PE64 console\n");
+    emit("include 'win64wx.inc' ;\n");
+    emit("entry start \n");
+    emit("section '.text' code readable executable\n");
+
+    emit("start:\n");
+    emit("sub rsp, 58\n");
+
+    emit("lea rcx, [main_argc]\n");
+    emit("lea rdx, [main_argv]\n");
+    emit("lea r8, [main_env_arr]\n");
+    emit("mov r9,0\n");
+
+    emit("lea rax, [rsp+8*(1+1+1+1+1)]\n");
+    emit("and qword [rax],0\n");
+    emit("mov qword [rsp+8*4],rax\n");
+
+    emit("call [__getmainargs]\n");
+
+    emit("and rsp, -16\n");
+    emit("mov rcx, [main_argc]\n");
+    emit("mov rdx, [main_argv]\n");
+
+    emit("jmp main\n");
+}
+
+///System V：ELF64目标文件，main由crt调用，库函数由链接器解析
+void elf_header () {
     int i = 0;
-    int j = 0;
-    fputs("format PE64 console\n", output);
-    fputs("include 'win64wx.inc' ;\n", output);
-    fputs("entry start \n", output);
-    fputs("section '.text' code readable executable\n", output);
 
-    fputs("start:\n",output);
-    fputs("sub rsp, 58\n", output);
+    emit("format ELF64\n");
+    emit("public main\n");
 
-    fputs("lea rcx, [main_argc]\n", output);
-    fputs("lea rdx, [main_argv]\n", output);
-    fputs("lea r8, [main_env_arr]\n", output);
-    fputs("mov r9,0\n", output);
+    for (i = 0; i < global_no; i++)
+    {
+        if (sym_is_extern[global_syms[i]])
+        {
+            emit("extrn ");
+            emit(sym_name[global_syms[i]]);
+            emit_char('\n');
+        }
+    }
+
+    emit("section '.text' executable\n");
+}
+
+///程序结尾
+/// 添加c语言库函数
+void pe_imports () {
+    emit("section '.idata' data readable import\n");
+    emit("library kernel32, 'kernel32.dll', msvcrt,   'msvcrt.dll',shell,'SHELL32.DLL' \n");//, crtdll, 'crtdll.dll'
+
+    emit("import kernel32, GetCommandLine,'GetCommandLineA', \\\n");
+    emit("ExitProcess,'ExitProcess' \n");
+    emit("import shell, CommandLineToArgv,'CommandLineToArgv'\n");
+
+    emit("import msvcrt, printf, 'printf', \\\n");
+    emit("getchar, 'getchar', \\\n");
+    emit("malloc,'malloc',\\\n");
+    emit("free,'free',\\\n");
+    emit("calloc,'calloc',\\\n");
+    emit("atoi,'atoi',\\\n");
+    emit("fopen,'fopen',\\\n");
+    emit("fclose,'fclose',\\\n");
+    emit("fread,'fread',\\\n");
+    emit("fseek,'fseek',\\\n");
+    emit("ftell,'ftell',\\\n");
+    emit("fgetc,'fgetc',\\\n");
+    emit("ungetc,'ungetc',\\\n");
+    emit("feof,'feof',\\\n");
+    emit("fputs,'fputs',\\\n");
+    emit("fprintf, 'fprintf', \\\n");
+    emit("puts,'puts',\\\n");
+    emit("isalpha,'isalpha',\\\n");
+    emit("isdigit,'isdigit',\\\n");
+    emit("isalnum,'isalnum',\\\n");
+    emit("strlen,'strlen',\\\n");
+    emit("strcmp,'strcmp',\\\n");
+    emit("strncmp,'strncmp',\\\n");
+    emit("strchr,'strchr',\\\n");
+    emit("strcpy,'strcpy',\\\n");
+    emit("strdup,'_strdup',\\\n");
+    emit("sprintf,'sprintf',\\\n");
+    emit("sscanf,'sscanf',\\\n");
+    emit("fwrite,'fwrite',\\\n");
+    emit("memcpy,'memcpy',\\\n");
+    emit("__getmainargs, '__getmainargs',\\\n");
+    emit("__wgetmainargs, '__wgetmainargs'\n");
+}
 
-    fputs("lea rax, [rsp+8*(1+1+1+1+1)]\n",output);
-    fputs("and qword [rax],0\n",output);
-    fputs("mov qword [rsp+8*4],rax\n", output);
+///在源代码之后接着编译profile_src，完了词法分析器回到原来的文件末尾
+void profile_runtime () {
+    int length = strlen(profile_src);
+    char* text = calloc(length+16, 1);
+    char* end = src_end;
+    char* at = cur;
+    char ch = saved_ch;
+    int line = curln;
+
+    memcpy(text, profile_src, length);
+    src_end = text + length;
+    cur = text;
+    saved_ch = cur[0];
+    instrument = false;
+    next();
 
-    fputs("call [__getmainargs]\n",output);
+    while (token != TOKEN_EOF) {
+        decl(DECL_MODULE);
+        out_flush(false);
+    }
 
-    fputs("and rsp, -16\n", output);
-    fputs("mov rcx, [main_argc]\n", output);
-    fputs("mov rdx, [main_argv]\n", output);
+    instrument = true;
+    src_end = end;
+    cur = at;
+    saved_ch = ch;
+    curln = line;
+    free(text);
+}
 
-    fputs("jmp main\n",output);
+void program () {
+    int i = 0;
+    int start = 0;
 
-    errors = 0;
+    if (abi == ABI_SYSV)
+        elf_header();
+    else
+        pe_header();
 
-    while (!feof(input))
+    if (stats)
+        start = stats_clock();
+
+    while (token != TOKEN_EOF) {
         decl(DECL_MODULE);
+        out_flush(false);
+    }
 
-    fputs("call	[getchar]\n",output);
+    if (instrument)
+        profile_runtime();
+
+    //Lexing is taken out of this later, see stats_lex_pass()
+    if (stats)
+    {
+        stats_parse = stats_clock() - start - stats_output;
+        start = stats_clock();
+    }
 
     ///此处添加全局变量的初始化
-    fputs("section '.data' data readable writeable\n", output);
+    if (abi == ABI_SYSV)
+        emit("section '.data' writeable\n");
+    else
+    {
+        emit("call	[getchar]\n");
+        emit("section '.data' data readable writeable\n");
+    }
+
     for(i=0;i<global_no;i++)
     {
-        if (!is_fn[i]){
-            fprintf(output, "%s dq  %u\n", globals[i],globals_init_val[i]);
+        int sym = global_syms[i];
+
+        if (!sym_is_fn[sym]){
+            emit(sym_name[sym]);
+            emit(" dq ");
+            emit(sym_init_text[sym] ? sym_init_text[sym] : "0");
+            emit_char('\n');
         }
     }
-    fputs("main_argc dq ?\nmain_argv dq ?\n main_env_arr dq ?\n", output);
-    fputs("db 0,0,0,0\n"
-          , output);
+    if (instrument)
+        profile_table();
+
+    if (abi == ABI_MS)
+        emit("main_argc dq ?\nmain_argv dq ?\n main_env_arr dq ?\n");
+
+    emit("db 0,0,0,0\n");
 
     /// 此处添加全局数据.现在只有字符串
-    ///
-    ///
-    if(const_strs_no>=1)
-        fputs("section '.rodata' data readable\n", output);
-    for(i=0;i<const_strs_no;i++)
+    if (str_no >= 1)
+        emit(abi == ABI_SYSV ? "section '.rodata'\n" : "section '.rodata' data readable\n");
+
+    str_emit();
+
+    if (abi == ABI_SYSV)
+        emit("section '.note.GNU-stack'\n");
+    else
+        pe_imports();
+
+    if (stats)
+        stats_emit = stats_clock() - start;
+}
+
+
+/// 声明系统内部函数
+void std_fns_def (char* std_fns, int type) {
+    typ = type;
+
+    //Remember that mini-c is typeless, so this is both a byte read and a 4 byte read.
+    //(char) 0xFF == -1, (int) 0xFFFFFF == -1
+    while (std_fns[0] != '\xff') {
+        new_fn(sym_intern(std_fns),1);
+        std_fns = std_fns+strlen(std_fns)+1;
+    }
+
+    typ = TYPE_UNKNOWN;
+}
+
+//==== Driver ====
+
+///输入文件，按命令行的顺序
+char** inputs;
+int input_no = 0;
+
+///-o：输出文件名，其中的%换成输入文件名去掉目录和扩展名
+char* out_pattern = 0;
+
+///-j：同时编译的文件数
+int jobs = 1;
+
+///--run：传给程序的参数，第一个是文件名
+char** run_args;
+int run_arg_no = 0;
+
+///一个输入对应的输出文件名
+//One input without -o still writes a.asm or a.o. Several inputs without
+//-o each get the input's name with the extension replaced.
+char* output_name (char* filename) {
+    char* base = filename;
+    char* name = 0;
+    int stem = 0;
+    int n = 0;
+    int i = 0;
+    int j = 0;
+
+    if (out_pattern == 0 && input_no == 1)
+        return obj_mode ? "a.o" : "a.asm";
+
+    for (i = 0; filename[i] != 0; i++)
+    {
+        if (filename[i] == '/' || filename[i] == '\\')
+            base = filename + i + 1;
+    }
+
+    //The base name up to its last dot
+    stem = strlen(base);
+
+    for (i = 0; base[i] != 0; i++)
+    {
+        if (base[i] == '.')
+            stem = i;
+    }
+
+    if (out_pattern == 0)
+    {
+        name = malloc(strlen(filename) + 8);
+        strcpy(name, filename);
+        strcpy(name + (base - filename) + stem, obj_mode ? ".o" : ".asm");
+        return name;
+    }
+
+    name = malloc((strlen(out_pattern) * (stem + 1)) + 1);
+
+    for (i = 0; out_pattern[i] != 0; i++)
     {
-        fprintf(output, "_%08d db ", const_strs_label[i]);
-        ///FIXME: "abcd" 此处双引号需要去掉。当前通过j=1..strlen-1去掉了。后期需要在别处去掉??
-        for(j=1;j<strlen(const_strs[i])-1;j++)
+        if (out_pattern[i] == '%')
         {
-            //if(strncmp(const_strs[i]+j,"\\",1)==0)
-            if(const_strs[i][j]=='\\')
-            {
-                ///此处下一个字符是特殊字符
-                {
-                    int f1=char_preprocess(const_strs[i]+j);
-                    fprintf(output, "%u, ", f1);
-                    j++;
-                }
-            }
-            else if(const_strs[i][j]=='\'') //  if(strncmp(const_strs[i]+j,"'",1)==0)
-            {
-                fprintf(output, "%u, ", '\'');
-            }
-            else
-            {
-                //正常字符，直接转为字符
-                fprintf(output, "'%c', ", (const_strs[i]+j)[0]);
-            }
+            for (j = 0; j < stem; j++)
+                name[n++] = base[j];
         }
-        fprintf(output, "0\n");
-    }
-
-    ///程序结尾
-    /// 添加c语言库函数
-    fputs("section '.idata' data readable import\n", output);
-    fputs("library kernel32, 'kernel32.dll', msvcrt,   'msvcrt.dll',shell,'SHELL32.DLL' \n", output);//, crtdll, 'crtdll.dll'
-
-    fputs("import kernel32, GetCommandLine,'GetCommandLineA', \\\n", output);
-    fputs("ExitProcess,'ExitProcess' \n",output);
-    fputs("import shell, CommandLineToArgv,'CommandLineToArgv'\n", output);
-
-    fputs("import msvcrt, printf, 'printf', \\\n", output);
-    fputs("getchar, 'getchar', \\\n",output);
-    fputs("malloc,'malloc',\\\n", output);
-    fputs("free,'free',\\\n", output);
-    fputs("calloc,'calloc',\\\n", output);
-    fputs("atoi,'atoi',\\\n", output);
-    fputs("fopen,'fopen',\\\n", output);
-    fputs("fclose,'fclose',\\\n", output);
-    fputs("fgetc,'fgetc',\\\n", output);
-    fputs("ungetc,'ungetc',\\\n", output);
-    fputs("feof,'feof',\\\n", output);
-    fputs("fputs,'fputs',\\\n", output);
-    fputs("fprintf, 'fprintf', \\\n",output);
-    fputs("puts,'puts',\\\n", output);
-    fputs("isalpha,'isalpha',\\\n", output);
-    fputs("isdigit,'isdigit',\\\n", output);
-    fputs("isalnum,'isalnum',\\\n", output);
-    fputs("strlen,'strlen',\\\n", output);
-    fputs("strcmp,'strcmp',\\\n", output);
-    fputs("strncmp,'strncmp',\\\n", output);
-    fputs("strchr,'strchr',\\\n", output);
-    fputs("strcpy,'strcpy',\\\n", output);
-    fputs("strdup,'_strdup',\\\n", output);
-    fputs("sprintf,'sprintf',\\\n", output);
-    fputs("__getmainargs, '__getmainargs',\\\n",output);
-    fputs("__wgetmainargs, '__wgetmainargs'\n",output);
+        else
+            name[n++] = out_pattern[i];
+    }
+
+    name[n] = 0;
+    return name;
 }
 
-/// argc argv获取方式：
-/// 3 msvcrt.dll 的 __getmainargs
-int main (int argc, char** argv)
-{
+///--stats：只做词法分析，把源代码再扫一遍
+//The lexer runs interleaved with the parser, and reading the clock
+//around every token would cost more than the token. So it is timed on
+//its own, after the compilation, and taken out of the parse time.
+void stats_lex_pass () {
+    int start = stats_clock();
+    int tokens = tok_count;
+
+    cache_recording = false;
+    cur[0] = saved_ch;
+    cur = src;
+    saved_ch = cur[0];
+    next();
 
-    if (argc != 2) {
-        puts("Usage: cc <file>");
-        printf(" %d %d\n", argc, argv);
-        return 1;
+    while (token != TOKEN_EOF)
+        next();
+
+    stats_lex = stats_clock() - start;
+    stats_parse = stats_parse - stats_lex;
+    tok_count = tokens;
+
+    if (stats_parse < 0)
+        stats_parse = 0;
+}
+
+///JSON的字符串，只需要转义引号和反斜杠
+void stats_json_str (char* str) {
+    int i = 0;
+
+    printf("\"");
+
+    for (i = 0; str[i] != 0; i++)
+    {
+        if (str[i] == '"' || str[i] == '\\')
+            printf("\\");
+
+        printf("%c", str[i]);
     }
-    printf(" %d %s\n", argc, argv[1]);
 
+    printf("\"");
+}
+
+void stats_report (char* filename) {
+    int i = 0;
+
+    if (stats == STATS_JSON)
+    {
+        printf("{\"file\": ");
+        stats_json_str(filename);
+        printf(", \"lex_us\": %d, \"parse_us\": %d, \"emit_us\": %d, \"output_us\": %d", stats_lex, stats_parse, stats_emit, stats_output);
+        printf(", \"tokens\": %d, \"symbol_lookups\": %d, \"symbol_probes\": %d", tok_count, sym_lookups, sym_probes);
+        printf(", \"labels\": %d, \"output_bytes\": %d, \"peak_kb\": %d", label_no, out_written, stats_peak());
+
+        if (cache_dir)
+            printf(", \"cache_hits\": %d, \"cache_misses\": %d", cache_hits, cache_misses);
+
+        if (peephole)
+        {
+            printf(", \"peephole\": [");
+
+            for (i = 0; i < PEEP_RULES; i++)
+            {
+                printf(i ? ", {\"rule\": " : "{\"rule\": ");
+                stats_json_str(peep_name[i]);
+                printf(", \"removed\": %d, \"rewrote\": %d}", peep_removed[i], peep_rewrote[i]);
+            }
+
+            printf("]");
+        }
+
+        printf("}\n");
+        return;
+    }
 
-    output = fopen("a.asm", "w");
-    printf("output file:%08x\n", output);
+    printf("%s: lex %d us, parse and codegen %d us, emit %d us, output %d us\n", filename, stats_lex, stats_parse, stats_emit, stats_output);
+    printf("%s: %d tokens, %d symbol lookups, %d probes, %d labels\n", filename, tok_count, sym_lookups, sym_probes, label_no);
+    printf("%s: %d bytes written, peak memory %d KB\n", filename, out_written, stats_peak());
 
-    lex_init(argv[1], 1024*50);
+    if (peephole)
+    {
+        for (i = 0; i < PEEP_RULES; i++)
+            printf("%s: peephole %s: removed %d, rewrote %d\n", filename, peep_name[i], peep_removed[i], peep_rewrote[i]);
+    }
+}
 
-    sym_init(4096);
+///编译已经在src里的源代码，输出到output或者内存
+//Every init starts its part of the state afresh, so a process can run
+//any number of compilations one after another.
+void translate () {
+    int start = 0;
+
+    out_init();
+    sym_init(1024);
+    node_init(4096);
+    fold_init();
+    str_init();
+    regalloc_init();
+    peep_init();
+    obj_init();
+    binop_init();
+    cache_init();
+    stats_init();
+    profile_init();
 
     //No arrays? Fine! A 0xFFFFFF terminated string of null terminated strings will do.
     //A negative-terminated null-terminated strings string, if you will
-    char* std_fns = "getchar\0malloc\0calloc\0free\0atoi\0fopen\0fclose\0fgetc\0ungetc\0feof\0fputs\0fprintf\0puts\0printf\0"
-                    "isalpha\0isdigit\0isalnum\0strlen\0strcmp\0strncmp\0strchr\0strcpy\0strdup\0sprintf\0\xFF\xFF\xFF\xFF";
+    //The results of the int ones are sign extended after the call
+    std_fns_def("getchar\0atoi\0fclose\0fseek\0fgetc\0ungetc\0feof\0fputs\0fprintf\0puts\0printf\0"
+                "isalpha\0isdigit\0isalnum\0strcmp\0strncmp\0sprintf\0sscanf\0\xFF\xFF\xFF\xFF", TYPE_INT);
+    std_fns_def("malloc\0calloc\0free\0fopen\0fread\0ftell\0strlen\0strchr\0strcpy\0strdup\0fwrite\0memcpy\0\xFF\xFF\xFF\xFF", TYPE_VOID_PTR);
 
-    /// 声明系统内部函数
-    //Remember that mini-c is typeless, so this is both a byte read and a 4 byte read.
-    //(char) 0xFF == -1, (int) 0xFFFFFF == -1
-    while (std_fns[0] != '\xff') {
-        char *tmp=strdup(std_fns);
-        new_fn(tmp,1);
-        std_fns = std_fns+strlen(std_fns)+1;
+    //POSIX only: msvcrt has nothing like them, so on Windows a call is an error
+    if (abi == ABI_SYSV)
+    {
+        std_fns_def("mprotect\0fork\0waitpid\0gettimeofday\0getrusage\0\xFF\xFF\xFF\xFF", TYPE_INT);
+        std_fns_def("mmap\0dlsym\0\xFF\xFF\xFF\xFF", TYPE_VOID_PTR);
     }
-    printf("parse start\n");
 
     program();
 
+    out_flush(true);
+
+    if (obj_mode && !run_mode)
+    {
+        start = stats ? stats_clock() : 0;
+        obj_write();
+
+        if (stats)
+            stats_output = stats_output + stats_clock() - start;
+    }
+}
+
+///编译一个文件
+int compile (char* filename) {
+    char* outname = output_name(filename);
+
+    //With --stats=json the object is all that goes to stdout
+    bool quiet = stats == STATS_JSON;
+
+    if (!lex_init(filename))
+        return 1;
+
+    if (!run_mode) {
+        if (!quiet)
+            printf(" %s -> %s\n", filename, outname);
+
+        output = fopen(outname, "wb");
+        outputname = outname;
+
+        if (output == 0) {
+            report(0, diag_format("cannot open for writing", "", ""));
+            return 1;
+        }
+
+        if (!quiet)
+            printf("parse start\n");
+    }
+
+    translate();
+
+    if (run_mode)
+        return errors ? 1 : jit_run(run_arg_no, run_args);
+
     fclose(output);
 
-    printf("parse finish!%d\n", errors);
+    if (!quiet)
+        printf("parse finish!%d\n", errors);
+
+    if (cache_dir && !quiet)
+        printf("cache hits:%d misses:%d\n", cache_hits, cache_misses);
+
+    if (stats)
+    {
+        stats_lex_pass();
+        stats_report(filename);
+    }
+
     return errors != 0;
 }
+
+///作为库使用：从内存编译到内存（out_mem），什么也不打印，返回错误个数
+//The options are the globals -O1, -fpeephole, -mabi and -c set. The
+//diagnostics stay in diag_line and diag_text until the next compilation.
+int compile_source (char* name, char* text, int length) {
+    output = 0;
+    outputname = 0;
+    diag_quiet = true;
+    run_mode = false;
+
+    lex_source(name, text, length);
+    translate();
+    return errors;
+}
+
+#ifdef _WIN32
+///Windows上没有fork：一个接一个地编译，-j不起作用
+//translate() starts every compilation afresh, as it does for libminic.
+int drive () {
+    int failed = 0;
+    int i = 0;
+
+    for (i = 0; i < input_no; i++)
+        failed = failed + (compile(inputs[i]) != 0);
+
+    return failed != 0;
+}
+#else
+///多个文件：每个文件在自己的子进程中编译，最多同时jobs个
+//Each compilation gets a fresh copy of all the globals this way. The
+//result is nonzero if any of them failed.
+int drive () {
+    int status[1];
+    int running = 0;
+    int failed = 0;
+    int pid = 0;
+    int i = 0;
+
+    //waitpid only writes the low 4 bytes of mini-c's 8 byte int
+    status[0] = 0;
+
+    for (i = 0; i < input_no; i++)
+    {
+        if (running == jobs)
+        {
+            waitpid(-1, status, 0);
+            failed = failed + (status[0] != 0);
+            running--;
+        }
+
+        pid = fork();
+
+        //The child compiles and exits through main
+        if (pid == 0)
+            return compile(inputs[i]);
+
+        else if (pid < 0)
+        {
+            puts("error: cannot start a compilation process");
+            failed++;
+            i = input_no;
+        }
+        else
+            running++;
+    }
+
+    while (running > 0) {
+        waitpid(-1, status, 0);
+        failed = failed + (status[0] != 0);
+        running--;
+    }
+
+    return failed != 0;
+}
+#endif
+
+/// argc argv获取方式：
+/// 3 msvcrt.dll 的 __getmainargs
+int main (int argc, char** argv)
+{
+    int i = 1;
+    int j = 0;
+
+    inputs = calloc(argc, PTR_SIZE);
+
+    //With --run the arguments after the file belong to the program
+    while (i < argc && !(run_mode && input_no)) {
+        if (strcmp(argv[i], "-O0") == 0)
+            ast_mode = false;
+        else if (strcmp(argv[i], "-O1") == 0)
+            ast_mode = true;
+        else if (strcmp(argv[i], "-fpeephole") == 0)
+            peephole = true;
+        else if (strcmp(argv[i], "-finstrument") == 0)
+            instrument = true;
+        else if (strncmp(argv[i], "-fcache=", 8) == 0)
+            cache_dir = argv[i]+8;
+        else if (strcmp(argv[i], "--stats") == 0)
+            stats = STATS_TEXT;
+        else if (strcmp(argv[i], "--stats=json") == 0)
+            stats = STATS_JSON;
+        else if (strcmp(argv[i], "-mabi=ms") == 0)
+            abi = ABI_MS;
+        else if (strcmp(argv[i], "-mabi=sysv") == 0)
+            abi = ABI_SYSV;
+        else if (strcmp(argv[i], "-c") == 0)
+            obj_mode = true;
+        else if (strcmp(argv[i], "--run") == 0)
+            run_mode = true;
+        else if (strcmp(argv[i], "-o") == 0 && i+1 < argc) {
+            i++;
+            out_pattern = argv[i];
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i+1 < argc) {
+            i++;
+            jobs = atoi(argv[i]);
+        }
+        else if (strncmp(argv[i], "-j", 2) == 0)
+            jobs = atoi(argv[i]+2);
+        else
+            inputs[input_no++] = argv[i];
+
+        i++;
+    }
+
+    if (input_no == 0 || jobs < 1) {
+        puts("Usage: cc [-O0|-O1] [-fpeephole] [-finstrument] [-fcache=dir] [--stats[=json]] [-mabi=ms|-mabi=sysv] [-c] [-j N] [-o out] <file>...");
+        puts("       cc [-O0|-O1] [-fpeephole] [-finstrument] --run <file> [args...]");
+        puts("With several files, a % in -o stands for each file's name without extension.");
+        return 1;
+    }
+
+    //The code runs on this machine, so it is System V
+    if (run_mode) {
+        abi = ABI_SYSV;
+        obj_mode = true;
+    }
+
+    if (obj_mode && abi != ABI_SYSV) {
+        puts("-c needs -mabi=sysv");
+        return 1;
+    }
+
+    if (input_no > 1 && out_pattern && !strchr(out_pattern, '%')) {
+        puts("-o needs a % with several files");
+        return 1;
+    }
+
+    //The program gets its own file name and the arguments after it
+    if (run_mode) {
+        run_args = calloc(argc, PTR_SIZE);
+
+        for (j = i - 1; j < argc; j++)
+            run_args[run_arg_no++] = argv[j];
+    }
+
+    if (input_no == 1)
+        return compile(inputs[0]);
+
+    return drive();
+}
@@ -0,0 +1,7 @@
+//The cc command: the driver in cc.c, linked from libminic.a
+
+#include "minic.h"
+
+int main (int argc, char** argv) {
+    return minic_main(argc, argv);
+}
@@ -0,0 +1,132 @@
+//---------------
+// libminic: the mini-c compiler as a library
+// MIT license
+//---------------
+
+//cc.c is written in the subset it compiles, so it has no structs and keeps
+//its state in globals. This file is only built by gcc: it gives callers
+//contexts that own their results, and runs one compilation at a time.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "minic.h"
+
+//From cc.c
+int compile_source (char* name, char* text, int length);
+
+extern bool ast_mode;
+extern bool peephole;
+extern bool obj_mode;
+extern bool instrument;
+extern int abi;
+extern int ABI_MS;
+extern int ABI_SYSV;
+
+extern char* out_mem;
+extern int out_mem_len;
+
+extern int* diag_line;
+extern char** diag_text;
+extern int diag_no;
+
+struct minic_context {
+    int flags;
+
+    char* output;
+    size_t output_len;
+
+    int diag_no;
+    int* diag_line;
+    char** diag_text;
+};
+
+static pthread_mutex_t compiler = PTHREAD_MUTEX_INITIALIZER;
+
+static void clear (minic_context* ctx) {
+    for (int i = 0; i < ctx->diag_no; i++)
+        free(ctx->diag_text[i]);
+
+    free(ctx->diag_text);
+    free(ctx->diag_line);
+    free(ctx->output);
+
+    ctx->output = 0;
+    ctx->output_len = 0;
+    ctx->diag_no = 0;
+    ctx->diag_line = 0;
+    ctx->diag_text = 0;
+}
+
+minic_context* minic_new (int flags) {
+    if ((flags & MINIC_OBJECT) && !(flags & MINIC_SYSV))
+        return 0;
+
+    minic_context* ctx = calloc(1, sizeof(minic_context));
+
+    if (ctx)
+        ctx->flags = flags;
+
+    return ctx;
+}
+
+void minic_free (minic_context* ctx) {
+    if (ctx) {
+        clear(ctx);
+        free(ctx);
+    }
+}
+
+int minic_compile (minic_context* ctx, const char* name, const char* source, size_t length) {
+    clear(ctx);
+
+    pthread_mutex_lock(&compiler);
+
+    ast_mode = ctx->flags & MINIC_O1;
+    peephole = ctx->flags & MINIC_PEEPHOLE;
+    obj_mode = ctx->flags & MINIC_OBJECT;
+    instrument = ctx->flags & MINIC_INSTRUMENT;
+    abi = (ctx->flags & MINIC_SYSV) ? ABI_SYSV : ABI_MS;
+
+    compile_source((char*) name, (char*) source, (int) length);
+
+    //Copied out, the compiler's buffers belong to the next compilation
+    ctx->output_len = out_mem_len;
+    ctx->output = malloc(out_mem_len + 1);
+    memcpy(ctx->output, out_mem, out_mem_len);
+    ctx->output[out_mem_len] = 0;
+
+    ctx->diag_no = diag_no;
+    ctx->diag_line = calloc(diag_no + 1, sizeof(int));
+    ctx->diag_text = calloc(diag_no + 1, sizeof(char*));
+
+    for (int i = 0; i < diag_no; i++) {
+        ctx->diag_line[i] = diag_line[i];
+        ctx->diag_text[i] = strdup(diag_text[i]);
+    }
+
+    pthread_mutex_unlock(&compiler);
+
+    return ctx->diag_no;
+}
+
+const char* minic_output (minic_context* ctx, size_t* length) {
+    if (length)
+        *length = ctx->output_len;
+
+    return ctx->output;
+}
+
+int minic_diagnostics (minic_context* ctx) {
+    return ctx->diag_no;
+}
+
+int minic_diagnostic_line (minic_context* ctx, int i) {
+    return i >= 0 && i < ctx->diag_no ? ctx->diag_line[i] : 0;
+}
+
+const char* minic_diagnostic_message (minic_context* ctx, int i) {
+    return i >= 0 && i < ctx->diag_no ? ctx->diag_text[i] : 0;
+}
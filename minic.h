@@ -0,0 +1,43 @@
+//---------------
+// libminic: the mini-c compiler as a library
+// MIT license
+//---------------
+
+#ifndef MINIC_H
+#define MINIC_H
+
+#include <stddef.h>
+
+//A context holds the options and the results of its last compilation.
+//Contexts can be used from any thread; compilations take turns, because
+//the compiler itself keeps its state in globals.
+typedef struct minic_context minic_context;
+
+//Options for minic_new
+#define MINIC_O1 1          // -O1
+#define MINIC_PEEPHOLE 2    // -fpeephole
+#define MINIC_SYSV 4        // -mabi=sysv instead of Win64
+#define MINIC_OBJECT 8      // -c: ELF object bytes instead of FASM source, needs MINIC_SYSV
+#define MINIC_INSTRUMENT 16 // -finstrument
+
+//Null if the options don't go together
+minic_context* minic_new (int flags);
+void minic_free (minic_context* ctx);
+
+//Compiles length bytes of source. The name is only used in diagnostics.
+//Returns the number of errors.
+int minic_compile (minic_context* ctx, const char* name, const char* source, size_t length);
+
+//The assembly or object of the last compilation, owned by the context
+const char* minic_output (minic_context* ctx, size_t* length);
+
+//The errors of the last compilation, in order. The line is 0 for errors
+//that don't belong to a line, like undefined symbols.
+int minic_diagnostics (minic_context* ctx);
+int minic_diagnostic_line (minic_context* ctx, int i);
+const char* minic_diagnostic_message (minic_context* ctx, int i);
+
+//The cc command line
+int minic_main (int argc, char** argv);
+
+#endif
@@ -0,0 +1,75 @@
+//Local arrays: indexing, passing one to a function that writes through
+//it, and a char array, also at -O1
+
+int fill (int* out, int n) {
+    int i = 0;
+
+    while (i < n) {
+        out[i] = i * i;
+        i++;
+    }
+
+    return n;
+}
+
+int sum (int* in, int n) {
+    int s = 0;
+    int i = 0;
+
+    while (i < n) {
+        s = s + in[i];
+        i++;
+    }
+
+    return s;
+}
+
+int squares () {
+    int a[8];
+    int n = fill(a, 8);
+    return sum(a, n) + a[3];
+}
+
+//Constant and variable indices, and a neighbour that must stay intact
+int indices (int k) {
+    int before = 11;
+    int a[4];
+    int after = 13;
+
+    a[0] = 1;
+    a[1] = a[0] + 1;
+    a[k] = 7;
+    a[k+1] = a[k] * 2;
+    return a[0] + a[1] + a[2] + a[3] + before + after;
+}
+
+int text_length (char* s) {
+    int n = 0;
+
+    while (s[n] != 0)
+        n++;
+
+    return n;
+}
+
+int letters () {
+    char buf[16];
+    int i = 0;
+
+    while (i < 5) {
+        buf[i] = 'a' + i;
+        i++;
+    }
+
+    buf[i] = 0;
+    buf[1] = 'Z';
+    printf("%s\n", buf);
+    return text_length(buf) + (buf[4] & 255);
+}
+
+int main () {
+    printf("%d\n", squares());
+    printf("%d\n", indices(2));
+    printf("%d\n", letters());
+    return 0;
+}
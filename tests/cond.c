@@ -0,0 +1,56 @@
+//Conditional compilation: #if 0 and #if 1, #elif, nesting, and _WIN32.
+//A branch that must be skipped does not even parse.
+
+#if 0
+int broken (
+#else
+int zero () {
+    return 1;
+}
+#endif
+
+#if 1
+int one () {
+    return 2;
+}
+#elif 1
+int broken (
+#else
+int broken (
+#endif
+
+#if 0
+int broken (
+#elif 1
+int chosen () {
+    return 4;
+}
+#endif
+
+#if 0
+#ifdef _WIN32
+int broken (
+#endif
+#if 1
+int broken (
+#endif
+#else
+int nested () {
+    return 8;
+}
+#endif
+
+#ifdef _WIN32
+int platform () {
+    return 100;
+}
+#else
+int platform () {
+    return 200;
+}
+#endif
+
+int main () {
+    printf("%d %d\n", zero() + one() + chosen() + nested(), platform());
+    return 0;
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+# make test: which branches of tests/cond.c are compiled, under both ABIs,
+# and the errors for conditionals mini-c cannot take.
+
+CC=${CC:-./cc}
+DIR=test.d
+failed=0
+
+mkdir -p $DIR
+
+# program, what the check is, expected text, actual text
+check () {
+    if [ "$3" != "$4" ]; then
+        echo "$1: $2: expected '$3', found '$4'"
+        failed=1
+    fi
+}
+
+check cond "-mabi=sysv" "15 200" "$($CC --run tests/cond.c)"
+
+# Windows code cannot run here, so look for the _WIN32 branch in it
+$CC -mabi=ms -o $DIR/cond.asm tests/cond.c > $DIR/cond.log
+check cond "-mabi=ms builds" "0" "$?"
+check cond "-mabi=ms takes _WIN32" "mov rax, 100" "$(grep -o 'mov rax, [12]00' $DIR/cond.asm)"
+
+printf '#if FOO\nint main () {\n    return 0;\n}\n#endif\n' > $DIR/cond_if.c
+$CC -mabi=sysv -o $DIR/cond_if.asm $DIR/cond_if.c > $DIR/cond_if.log
+check cond_if "#if FOO fails" "1" "$?"
+check cond_if "#if FOO" "$DIR/cond_if.c:1: error: #if and #elif only take 0 or 1" \
+    "$(grep error: $DIR/cond_if.log)"
+
+printf 'int main () {\n    return 0;\n}\n#ifdef FOO\nint f () {\n' > $DIR/cond_open.c
+$CC -mabi=sysv -o $DIR/cond_open.asm $DIR/cond_open.c > $DIR/cond_open.log
+check cond_open "#ifdef without #endif fails" "1" "$?"
+check cond_open "#ifdef without #endif" "$DIR/cond_open.c:4: error: unterminated conditional" \
+    "$(grep error: $DIR/cond_open.log)"
+
+[ $failed -eq 0 ] && echo "conditionals pass"
+exit $failed
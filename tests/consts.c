@@ -0,0 +1,38 @@
+//Constant propagation at -O1: chains, and reads before the only write
+
+int chain () {
+    int a = 2;
+    int b = a * 3;
+    int c = b + a;
+    int d = c - 1;
+    return d + c;
+}
+
+//x is read in the loop before it is written, so the store must stay
+int loop (int n) {
+    int x;
+    int i = 0;
+    int s = 0;
+
+    while (i < n) {
+        if (i > 0)
+            s = s + x;
+
+        x = 5;
+        i++;
+    }
+
+    return s + x;
+}
+
+int twice () {
+    int d = 1;
+    int e = d + 1;
+    d = e + 1;
+    return d + e;
+}
+
+int main () {
+    printf("%d %d %d\n", chain(), loop(4), twice());
+    return 0;
+}
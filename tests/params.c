@@ -0,0 +1,39 @@
+//Parameters assigned once must keep the argument until then, also at -O1
+
+int once (int p) {
+    int v;
+    v = p + 1;
+    p = 9;
+    return v + p;
+}
+
+int only_write (int p) {
+    p = 5;
+    return p;
+}
+
+int seven (int a, int b, int c, int d, int e, int f, int g) {
+    int before = a + g;
+    a = 1;
+    g = 2;
+    return before + a + g + b + c + d + e + f;
+}
+
+int loop (int n) {
+    int sum = 0;
+
+    while (n) {
+        sum = sum + n;
+        n = 0;
+    }
+
+    return sum;
+}
+
+int main () {
+    printf("%d\n", once(37));
+    printf("%d\n", only_write(37));
+    printf("%d\n", seven(10, 2, 3, 4, 5, 6, 70));
+    printf("%d\n", loop(37));
+    return 0;
+}
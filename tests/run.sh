@@ -0,0 +1,77 @@
+#!/bin/sh
+# make test: every program in tests/ under each mode, against -O0.
+#
+# A program prints what it computes and exits with a status. Its -O0
+# build is the reference: the fasm text path if fasm is installed, -c
+# otherwise. Every other mode must print the same and exit with the same
+# status. Each program gets the argument 5.
+
+CC=${CC:-./cc}
+ABI=${ABI:--mabi=sysv}
+DIR=test.d
+
+# Modes are flags with _ for spaces; --run ones compile into memory
+MODES="-O1 -O1_-fpeephole -finstrument --run -O1_--run"
+
+# program, flags, output file
+build_run () {
+    case "$2" in
+    *--run*)
+        $CC $2 tests/$1.c 5 > $DIR/$3
+        echo "exit $?" >> $DIR/$3
+        return ;;
+    *-c*)
+        $CC $ABI $2 -o $DIR/$1.o tests/$1.c > $DIR/$1.log ;;
+    *)
+        $CC $ABI $2 -o $DIR/$1.asm tests/$1.c > $DIR/$1.log &&
+        fasm $DIR/$1.asm $DIR/$1.o > /dev/null ;;
+    esac
+
+    if [ $? -ne 0 ] || ! gcc -no-pie $DIR/$1.o -o $DIR/$1; then
+        echo "does not build" > $DIR/$3
+        return
+    fi
+
+    (cd $DIR && ./$1 5 > $3; echo "exit $?" >> $3)
+}
+
+mkdir -p $DIR
+failed=0
+
+if command -v fasm > /dev/null; then
+    REF="-O0"
+    MODES="-c $MODES"
+else
+    REF="-c"
+fi
+
+for file in tests/*.c; do
+    name=$(basename $file .c)
+    build_run $name "$REF" $name.ref
+
+    if grep -q "does not build" $DIR/$name.ref; then
+        echo "$name: does not build with $REF"
+        failed=1
+        continue
+    fi
+
+    for mode in $MODES; do
+        flags=$(echo $mode | tr _ ' ')
+
+        case "$flags" in
+        *--run*|*-c*) ;;
+        *) flags="$flags -c" ;;
+        esac
+
+        build_run $name "$flags" $name.out
+
+        if ! cmp -s $DIR/$name.ref $DIR/$name.out; then
+            echo "$name: $flags differs from -O0"
+            diff $DIR/$name.ref $DIR/$name.out | head -10
+            failed=1
+        fi
+    done
+done
+
+[ $failed -eq 0 ] && echo "all tests pass"
+exit $failed
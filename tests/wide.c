@@ -0,0 +1,30 @@
+//Integer literals that need more than 32 bits, in every register
+
+int big = 5000000000;
+int small = 7;
+
+int add (int a, int b) {
+    return a + b;
+}
+
+int main () {
+    int x = 5000000000;
+    int y = 3000000000 + small;
+    int z = 0 - 9000000000000000000;
+    int i = 0;
+    int sum = 0;
+
+    printf("%lld %lld %lld %lld\n", x, big, y, z);
+    printf("%lld\n", add(4294967296, 4294967295));
+
+    //The loop keeps x, y, z and sum in callee-saved registers at -O1
+    for (i = 0; i < 3; i++)
+        sum = sum + x + y + z + 2147483648;
+
+    printf("%lld\n", sum);
+
+    if (x > 4999999999 && big == 5000000000)
+        puts("compare ok");
+
+    return (x - 4999999999) & 255;
+}